@@ -0,0 +1,482 @@
+"""Compact container format for the compiled light programs of all the drones
+in a show.
+
+Drones that run the same light program share a single copy of its bytecode
+in the archive; each drone stores only the index of its light program, its
+start offset and its playback rate. A wave of a thousand drones that run the
+same light program with different start delays therefore costs one light
+program and a thousand small integers.
+
+The layout of an archive is as follows; all integers are varuints:
+
+- the magic bytes ``LCSA``, followed by a version byte (currently 1) and a
+  flags byte,
+- the number of light programs, followed by the length and the bytecode of
+  each light program,
+- the number of drones, followed by the index of the light program of each
+  drone and its start offset, in frames at ``Duration.FPS`` frames per
+  second, zigzag-encoded so negative offsets are also allowed,
+- if the ``FLAG_RATES`` flag is set, the numerator and the denominator of the
+  playback rate of each drone.
+
+If the ``FLAG_PHRASES`` flag is set, the light programs are compressed with
+a phrase dictionary that is shared by all the light programs in the archive.
+A phrase is a sequence of consecutive top-level instructions that appears in
+multiple light programs (e.g., the same strobe burst or color cycle). The
+dictionary is stored right after the flags byte as the number of phrases,
+followed by the length and the bytecode of each phrase. Each light program
+is then stored as its encoded length followed by a sequence of items; an
+item is a varuint that holds either the index of a phrase (``2 * index + 1``)
+or the length of a literal run of bytecode that follows the item
+(``2 * length``). Light programs are expanded when the archive is loaded so
+users of the archive always see plain bytecode.
+"""
+
+from collections import Counter
+from fractions import Fraction
+from typing import Dict, List, NamedTuple, Optional, Sequence, Tuple, Union
+
+from .compiler.ast import Duration
+from .compiler.errors import BytecodeParserError
+from .parsers.bytecode import Buffer, BytecodeParser
+from .player import Player, Rate
+from .swarm import SwarmPlayer
+from .varuint import decode_varuint, encode_varuint_into, varuint_length
+
+__all__ = ("DroneTrack", "InvalidArchiveError", "ShowArchive")
+
+
+MAGIC = b"LCSA"
+"""Magic bytes at the start of each archive."""
+
+VERSION = 1
+"""The version of the archive format written by this module."""
+
+FLAG_RATES = 1
+"""Flag that marks archives that store the playback rates of the drones."""
+
+FLAG_PHRASES = 2
+"""Flag that marks archives whose light programs are compressed with a
+shared phrase dictionary.
+"""
+
+PHRASE_LENGTHS = (32, 16, 8, 4, 2)
+"""The lengths of the phrases that the phrase dictionary compressor looks
+for, in top-level instructions, in the order they are considered.
+"""
+
+
+class InvalidArchiveError(RuntimeError):
+    """Error raised when an archive cannot be decoded."""
+
+    pass
+
+
+class DroneTrack(NamedTuple):
+    """The light program of a single drone in an archive, along with the time
+    base that the light program is played in.
+    """
+
+    program: int
+    """The index of the light program of the drone in the archive."""
+
+    offset: int = 0
+    """The start offset of the light program of the drone, in frames at
+    ``Duration.FPS`` frames per second.
+    """
+
+    rate: Fraction = Fraction(1)
+    """The playback rate of the light program of the drone."""
+
+    @property
+    def offset_in_seconds(self) -> float:
+        """The start offset of the light program of the drone, in seconds."""
+        return self.offset / float(Duration.FPS)
+
+
+class ShowArchive:
+    """Compiled light programs of all the drones in a show, with per-drone
+    start offsets and playback rates over shared light programs.
+    """
+
+    programs: List[Buffer]
+    """The distinct light programs in the archive, in compiled bytecode
+    format.
+    """
+
+    drones: List[DroneTrack]
+    """The light programs and time bases of the drones in the archive."""
+
+    @classmethod
+    def from_bytes(cls, data: Buffer):
+        """Decodes an archive from its binary representation.
+
+        The light programs of the decoded archive are slices of the given
+        buffer; they are not copied so the buffer may be a memory-mapped
+        file. The buffer must not be modified while the archive is in use.
+        Light programs of archives with a phrase dictionary are expanded into
+        new bytes objects instead.
+
+        Raises:
+            InvalidArchiveError: if the buffer does not contain a valid
+                archive
+        """
+        view = memoryview(data)
+        if view.ndim != 1 or view.itemsize != 1:
+            view = view.cast("B")
+
+        if len(view) < 6 or bytes(view[:4]) != MAGIC:
+            raise InvalidArchiveError("not a show archive")
+        if view[4] != VERSION:
+            raise InvalidArchiveError(
+                "unsupported archive version: {0}".format(view[4])
+            )
+        flags = view[5]
+
+        result = cls()
+        try:
+            pos = 6
+            if flags & FLAG_PHRASES:
+                phrases, pos = _decode_chunks(view, pos)
+                programs, pos = _decode_chunks(view, pos)
+                result.programs.extend(
+                    _expand_program(program, phrases) for program in programs
+                )
+            else:
+                programs, pos = _decode_chunks(view, pos)
+                result.programs.extend(programs)
+            num_programs = len(programs)
+
+            num_drones, pos = decode_varuint(view, pos)
+            tracks = []
+            for _ in range(num_drones):
+                program, pos = decode_varuint(view, pos)
+                offset, pos = decode_varuint(view, pos)
+                if program >= num_programs:
+                    raise InvalidArchiveError(
+                        "invalid light program index: {0}".format(program)
+                    )
+                tracks.append((program, _decode_zigzag(offset)))
+
+            if flags & FLAG_RATES:
+                for program, offset in tracks:
+                    numerator, pos = decode_varuint(view, pos)
+                    denominator, pos = decode_varuint(view, pos)
+                    if numerator == 0 or denominator == 0:
+                        raise InvalidArchiveError("playback rates must be positive")
+                    result.drones.append(
+                        DroneTrack(program, offset, Fraction(numerator, denominator))
+                    )
+            else:
+                result.drones.extend(DroneTrack(*track) for track in tracks)
+        except EOFError:
+            raise InvalidArchiveError("unexpected end of archive") from None
+
+        if pos != len(view):
+            raise InvalidArchiveError("unexpected data after the end of the archive")
+
+        return result
+
+    def __init__(self):
+        """Constructor.
+
+        Creates an empty archive.
+        """
+        self.programs = []
+        self.drones = []
+        self._program_indices: Optional[Dict[bytes, int]] = None
+
+    def __len__(self) -> int:
+        return len(self.drones)
+
+    def add_program(self, bytecode: Buffer) -> int:
+        """Adds a light program in compiled bytecode format to the archive
+        unless an identical light program is already in the archive.
+
+        Returns:
+            the index of the light program in the archive
+        """
+        indices = self._program_indices
+        if indices is None:
+            indices = self._program_indices = {
+                bytes(program): index for index, program in enumerate(self.programs)
+            }
+
+        key = bytes(bytecode)
+        index = indices.get(key)
+        if index is None:
+            index = indices[key] = len(self.programs)
+            self.programs.append(key)
+        return index
+
+    def add_drone(self, bytecode: Buffer, offset: int = 0, rate: Rate = 1) -> int:
+        """Adds a drone to the archive.
+
+        Parameters:
+            bytecode: the light program of the drone in compiled bytecode
+                format. Identical light programs are stored only once.
+            offset: the start offset of the light program of the drone, in
+                frames at ``Duration.FPS`` frames per second
+            rate: the playback rate of the light program of the drone
+
+        Returns:
+            the index of the drone in the archive
+
+        Raises:
+            ValueError: if the playback rate is not positive
+        """
+        rate = Fraction(rate)
+        if rate <= 0:
+            raise ValueError("playback rate must be positive")
+        self.drones.append(DroneTrack(self.add_program(bytecode), int(offset), rate))
+        return len(self.drones) - 1
+
+    def create_players(self) -> List[Player]:
+        """Creates a player for each light program in the archive, in the
+        order of the light programs.
+        """
+        return [Player.from_bytes(program) for program in self.programs]
+
+    def create_swarm_player(self) -> SwarmPlayer:
+        """Creates a swarm player that plays the light programs of all the
+        drones in the archive in their own time bases.
+
+        Drones that share a light program share the player of the light
+        program too.
+        """
+        players = self.create_players()
+        drones = self.drones
+        if all(drone.offset == 0 and drone.rate == 1 for drone in drones):
+            return SwarmPlayer(players[drone.program] for drone in drones)
+        else:
+            return SwarmPlayer(
+                (players[drone.program] for drone in drones),
+                offsets=[drone.offset_in_seconds for drone in drones],
+                rates=[float(drone.rate) for drone in drones],
+            )
+
+    def to_bytes(self, phrases: bool = False) -> bytes:
+        """Returns the binary representation of the archive.
+
+        Parameters:
+            phrases: whether to compress the light programs with a phrase
+                dictionary that is shared by all the light programs. This
+                makes the archive smaller if the light programs have common
+                instruction sequences, at the expense of slower encoding and
+                decoding.
+        """
+        drones = self.drones
+        has_rates = any(drone.rate != 1 for drone in drones)
+
+        output = bytearray(MAGIC)
+        output.append(VERSION)
+        output.append(
+            (FLAG_RATES if has_rates else 0) | (FLAG_PHRASES if phrases else 0)
+        )
+
+        if phrases:
+            dictionary, programs = _compress_programs(self.programs)
+            _encode_chunks_into(output, dictionary)
+            _encode_chunks_into(output, programs)
+        else:
+            _encode_chunks_into(output, self.programs)
+
+        encode_varuint_into(output, len(drones))
+        for drone in drones:
+            encode_varuint_into(output, drone.program)
+            encode_varuint_into(output, _encode_zigzag(drone.offset))
+
+        if has_rates:
+            for drone in drones:
+                encode_varuint_into(output, drone.rate.numerator)
+                encode_varuint_into(output, drone.rate.denominator)
+
+        return bytes(output)
+
+
+def _encode_zigzag(value: int) -> int:
+    """Maps signed integers to non-negative integers so that values with
+    small magnitudes are mapped to small integers.
+    """
+    return value * 2 if value >= 0 else -value * 2 - 1
+
+
+def _decode_zigzag(value: int) -> int:
+    """Inverse of ``_encode_zigzag()``."""
+    return value >> 1 if not value & 1 else -((value + 1) >> 1)
+
+
+def _decode_chunks(view: memoryview, pos: int) -> Tuple[List[memoryview], int]:
+    """Decodes a list of length-prefixed chunks of bytes, preceded by the
+    number of chunks, from the given buffer.
+
+    Returns:
+        slices of the buffer for the chunks and the index of the first byte
+        after the last chunk
+    """
+    count, pos = decode_varuint(view, pos)
+    result = []
+    for _ in range(count):
+        length, pos = decode_varuint(view, pos)
+        if pos + length > len(view):
+            raise EOFError("unexpected end of data in chunk")
+        result.append(view[pos : pos + length])
+        pos += length
+    return result, pos
+
+
+def _encode_chunks_into(output: bytearray, chunks: Sequence[Buffer]) -> None:
+    """Encodes a list of chunks of bytes into the given buffer, in the format
+    that ``_decode_chunks()`` expects.
+    """
+    encode_varuint_into(output, len(chunks))
+    for chunk in chunks:
+        encode_varuint_into(output, len(chunk))
+        output += chunk
+
+
+def _expand_program(encoded: memoryview, phrases: Sequence[memoryview]) -> bytes:
+    """Expands a light program that was compressed with a phrase dictionary.
+
+    Raises:
+        InvalidArchiveError: if the light program refers to a phrase that is
+            not in the dictionary or a literal run extends beyond the end of
+            the light program
+    """
+    parts = []
+    pos, end = 0, len(encoded)
+    while pos < end:
+        item, pos = decode_varuint(encoded, pos)
+        if item & 1:
+            index = item >> 1
+            if index >= len(phrases):
+                raise InvalidArchiveError("invalid phrase index: {0}".format(index))
+            parts.append(phrases[index])
+        else:
+            length = item >> 1
+            if pos + length > end:
+                raise InvalidArchiveError("literal run extends beyond light program")
+            parts.append(encoded[pos : pos + length])
+            pos += length
+    return b"".join(parts)
+
+
+_Item = Union[bytes, int]
+"""An item in a light program that is being compressed; either the bytecode
+of a top-level instruction or the index of a phrase.
+"""
+
+
+def _split_into_instructions(program: Buffer) -> List[bytes]:
+    """Splits a light program into the bytecode of its top-level
+    instructions. Light programs that cannot be parsed are kept in one
+    piece.
+    """
+    program = bytes(program)
+    if not program:
+        return []
+
+    try:
+        statements = BytecodeParser().parse(program).statements
+    except BytecodeParserError:
+        return [program]
+
+    result = [statement.to_bytecode() for statement in statements]
+    return result if b"".join(result) == program else [program]
+
+
+def _replace_phrases(
+    sequences: List[List[_Item]],
+    length: int,
+    phrases: List[bytes],
+    candidates: Dict[Tuple[bytes, ...], Optional[int]],
+) -> None:
+    """Replaces the occurrences of the given candidate phrases of the given
+    length in the sequences with phrase indices, from left to right. Phrases
+    are added to the dictionary when they are used for the first time.
+    """
+    for sequence in sequences:
+        result: List[_Item] = []
+        i, n = 0, len(sequence)
+        while i < n:
+            window = tuple(sequence[i : i + length])
+            if len(window) == length and window in candidates:
+                index = candidates[window]
+                if index is None:
+                    index = candidates[window] = len(phrases)
+                    phrases.append(b"".join(window))  # type: ignore
+                result.append(index)
+                i += length
+            else:
+                result.append(sequence[i])
+                i += 1
+        sequence[:] = result
+
+
+def _compress_programs(programs: Sequence[Buffer]) -> Tuple[List[bytes], List[bytes]]:
+    """Compresses the given light programs with a shared phrase dictionary.
+
+    Phrases are found greedily, from the longest to the shortest: sequences
+    of top-level instructions of a given length that occur at least twice
+    and whose replacement saves space are added to the dictionary, and their
+    occurrences are replaced with references before shorter phrases are
+    considered. Phrases that end up being used only once are inlined again.
+
+    Returns:
+        the phrase dictionary and the encoded light programs
+    """
+    sequences: List[List[_Item]] = [
+        list(_split_into_instructions(program)) for program in programs
+    ]
+    phrases: List[bytes] = []
+
+    for length in PHRASE_LENGTHS:
+        counts: Counter = Counter()
+        for sequence in sequences:
+            run_start = 0
+            for i, item in enumerate(sequence):
+                if isinstance(item, int):
+                    run_start = i + 1
+                elif i + 1 - run_start >= length:
+                    counts[tuple(sequence[i + 1 - length : i + 1])] += 1
+
+        candidates: Dict[Tuple[bytes, ...], Optional[int]] = {}
+        for window, count in counts.items():
+            size = sum(len(item) for item in window)
+            cost = size + varuint_length(size) + 2 * count
+            if count > 1 and count * size > cost:
+                candidates[window] = None
+
+        if candidates:
+            _replace_phrases(sequences, length, phrases, candidates)
+
+    # Inline phrases that are used only once and renumber the rest
+    uses = Counter(
+        item for sequence in sequences for item in sequence if isinstance(item, int)
+    )
+    mapping: Dict[int, int] = {}
+    dictionary: List[bytes] = []
+    for index, phrase in enumerate(phrases):
+        if uses[index] > 1:
+            mapping[index] = len(dictionary)
+            dictionary.append(phrase)
+
+    encoded_programs = []
+    for sequence in sequences:
+        output = bytearray()
+        literal = bytearray()
+        for item in sequence:
+            if isinstance(item, int) and item in mapping:
+                if literal:
+                    encode_varuint_into(output, len(literal) << 1)
+                    output += literal
+                    literal.clear()
+                encode_varuint_into(output, (mapping[item] << 1) | 1)
+            else:
+                literal += phrases[item] if isinstance(item, int) else item
+        if literal:
+            encode_varuint_into(output, len(literal) << 1)
+            output += literal
+        encoded_programs.append(bytes(output))
+
+    return dictionary, encoded_programs
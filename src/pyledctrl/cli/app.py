@@ -1,10 +1,12 @@
 """Main application class for PyLedCtrl"""
 
+import os
 import sys
 
 from pathlib import Path
 
 from pyledctrl.compiler import BytecodeCompiler
+from pyledctrl.compiler.formats import OutputFormat
 
 from .utils import execute_and_write_tabular
 
@@ -41,6 +43,26 @@ def cli():
     "1 = only basic optimisations, 2 = aggressive optimisation (default).",
     default=2,
 )
+@click.option(
+    "-t",
+    "--color-tolerance",
+    type=click.IntRange(0, 255),
+    metavar="UNITS",
+    help="allow the optimiser to change each color channel by at most this "
+    "many units in order to merge nearly identical colors. 0 = keep colors "
+    "intact (default).",
+    default=0,
+)
+@click.option(
+    "-j",
+    "--timing-tolerance",
+    type=click.IntRange(0, None),
+    metavar="FRAMES",
+    help="allow the durations of the commands in different iterations of a "
+    "loop to differ by at most this many frames when detecting loops. 0 = "
+    "iterations must be identical (default).",
+    default=0,
+)
 @click.option(
     "-p",
     "--progress",
@@ -56,7 +78,9 @@ def cli():
     help="Print additional messages about the compilation process above the progress bar.",
 )
 @click.argument("filename", required=True)
-def compile(filename, output, optimisation, progress, verbose):
+def compile(
+    filename, output, optimisation, color_tolerance, timing_tolerance, progress, verbose
+):
     """Compiles a LedCtrl source file to a bytecode file.
 
     Takes a single input filename as its only argument.
@@ -65,10 +89,32 @@ def compile(filename, output, optimisation, progress, verbose):
         output = Path(filename).with_suffix(".bin")
 
     compiler = BytecodeCompiler(
-        optimisation_level=optimisation, progress=progress, verbose=verbose
+        optimisation_level=optimisation,
+        color_tolerance=color_tolerance,
+        timing_tolerance=timing_tolerance,
+        progress=progress,
+        verbose=verbose,
     )
     compiler.compile(filename, output)
 
+    report = compiler.color_quantisation_report
+    if verbose and report is not None:
+        click.echo(
+            "Color quantisation: {0.num_colors} colors reduced to "
+            "{0.num_representatives}, {0.num_commands_changed} commands "
+            "changed, max. error: {0.max_error}".format(report)
+        )
+        (exact,) = BytecodeCompiler(optimisation_level=optimisation).compile(
+            filename, output_format=OutputFormat.LEDCTRL_BINARY
+        )
+        size = os.path.getsize(output)
+        click.echo(
+            "Output size: {0} bytes, {1} bytes without color quantisation "
+            "({2:+.1f}%)".format(
+                size, len(exact), (size / len(exact) - 1) * 100 if exact else 0
+            )
+        )
+
 
 @cli.command()
 @click.option(
@@ -100,6 +146,183 @@ def dump(filename, output, unroll):
     return execute_and_write_tabular(filename, output, unroll)
 
 
+@cli.command()
+@click.option(
+    "-o",
+    "--output",
+    type=click.File("wb"),
+    help="name of the output file; the standard output when omitted",
+    default="-",
+)
+@click.option(
+    "-r",
+    "--fps",
+    type=click.IntRange(1, None),
+    metavar="FPS",
+    help="the number of frames per second (default: 25)",
+    default=25,
+)
+@click.option(
+    "-d",
+    "--duration",
+    type=float,
+    metavar="SECONDS",
+    help="the duration of the stream. When omitted, the stream ends when the "
+    "light program of the last drone ends; required if a light program "
+    "contains an infinite loop.",
+    default=None,
+)
+@click.option(
+    "--order",
+    type=click.File("r"),
+    metavar="FILENAME",
+    help="name of a file that lists the zero-based indices of the drones in "
+    "the order they should appear in each frame, separated by whitespace",
+    default=None,
+)
+@click.option(
+    "-t",
+    "--color-tolerance",
+    type=click.IntRange(0, 255),
+    metavar="UNITS",
+    help="allow each color channel to differ from the exact color by at most "
+    "this many units in exchange for faster playback. 0 = exact colors "
+    "(default).",
+    default=0,
+)
+@click.argument("filenames", nargs=-1, required=True)
+def stream(filenames, output, fps, duration, order, color_tolerance):
+    """\
+    Writes the colors of a show as a raw stream of RGB frames.
+
+    Takes the light programs of the drones as LedCtrl source or bytecode
+    files, one drone per file, or a single show archive. Each frame of the
+    output consists of three bytes (red, green and blue) per drone.
+    """
+    from pyledctrl.archive import MAGIC, ShowArchive
+    from pyledctrl.export import export_rgb_stream
+
+    data = Path(filenames[0]).read_bytes() if len(filenames) == 1 else b""
+    if data.startswith(MAGIC):
+        show = ShowArchive.from_bytes(data)
+    else:
+        compiler = BytecodeCompiler()
+        show = ShowArchive()
+        for filename in filenames:
+            for program in compiler.compile(
+                filename, output_format=OutputFormat.LEDCTRL_BINARY
+            ):
+                show.add_drone(program)
+
+    if order is not None:
+        order = [int(index) for index in order.read().split()]
+
+    try:
+        num_frames = export_rgb_stream(
+            show,
+            output,
+            fps=fps,
+            duration=duration,
+            order=order,
+            tolerance=color_tolerance,
+        )
+    except ValueError as ex:
+        raise click.UsageError(str(ex))
+    click.echo(
+        "{0} frames of {1} drones written".format(
+            num_frames, len(show) if order is None else len(order)
+        ),
+        err=True,
+    )
+
+
+@cli.command()
+@click.option(
+    "-O",
+    "--optimise",
+    "optimisation",
+    type=int,
+    metavar="LEVEL",
+    help="the optimisation level to use. 0 = no optimisation, "
+    "1 = only basic optimisations, 2 = aggressive optimisation (default).",
+    default=2,
+)
+@click.option(
+    "-f",
+    "--format",
+    "output_format",
+    type=click.Choice(["bin", "json", "oled"]),
+    help="the format of the output files, written next to the source files.",
+    default="bin",
+)
+@click.option(
+    "--poll",
+    default=False,
+    is_flag=True,
+    help="Detect changes by polling the file system instead of relying on "
+    "notifications from the operating system.",
+)
+@click.option(
+    "--exact",
+    default=False,
+    is_flag=True,
+    help="Optimise each program as a whole so the output is the same as the "
+    "output of the compile command. Recompilation is slower without the "
+    "approximate, chunked optimisation that is used by default.",
+)
+@click.argument(
+    "directory", required=False, default=".", type=click.Path(file_okay=False)
+)
+def watch(directory, optimisation, output_format, poll, exact):
+    """Watches a directory for changes and recompiles the LedCtrl source
+    files in it as soon as they are modified.
+
+    Source files whose compiled output is missing or outdated are compiled
+    when the command starts. Press Ctrl-C to stop watching.
+
+    By default, programs are optimised in cached chunks to make
+    recompilation fast, so the output may be larger than the output of the
+    compile command. Use --exact to get the same output as the compile
+    command.
+    """
+    from .watch import Watcher, create_file_monitor
+
+    output_format = {
+        "bin": OutputFormat.LEDCTRL_BINARY,
+        "json": OutputFormat.LEDCTRL_JSON,
+        "oled": OutputFormat.LEDCTRL_SOURCE,
+    }[output_format]
+
+    def report(result):
+        if result.error is not None:
+            click.secho(
+                "{0}: {1}".format(result.input, result.error), fg="red", err=True
+            )
+        else:
+            click.echo(
+                "{0} -> {1} ({2:.1f} ms)".format(
+                    result.input, result.output, result.duration * 1000
+                )
+            )
+
+    monitor = create_file_monitor(directory, polling=poll)
+    try:
+        watcher = Watcher(
+            monitor,
+            optimisation_level=optimisation,
+            output_format=output_format,
+            chunked=not exact,
+        )
+        for result in watcher.compile_outdated_files():
+            report(result)
+        click.echo("Watching {0} for changes...".format(monitor.root), err=True)
+        watcher.run(report)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        monitor.close()
+
+
 def main():
     """Main entry point of the compiler."""
     cli()
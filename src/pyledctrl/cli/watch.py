@@ -0,0 +1,463 @@
+"""Watch mode of the command line interface that recompiles LedCtrl source
+files as soon as they change on the disk.
+"""
+
+import os
+
+from hashlib import blake2b
+from threading import Event, Lock
+from time import monotonic, perf_counter
+from typing import (
+    Callable,
+    Dict,
+    Iterable,
+    List,
+    NamedTuple,
+    Optional,
+    Set,
+    Tuple,
+)
+
+from pyledctrl.compiler import BytecodeCompiler
+from pyledctrl.compiler.formats import OutputFormat
+from pyledctrl.utils import write_file_atomically
+
+__all__ = (
+    "FileMonitor",
+    "PollingFileMonitor",
+    "WatchdogFileMonitor",
+    "WatchResult",
+    "Watcher",
+    "create_file_monitor",
+)
+
+
+class WatchResult(NamedTuple):
+    """Result of processing a single changed file in watch mode."""
+
+    input: str
+    """The name of the input file."""
+
+    output: Optional[str] = None
+    """The name of the output file; ``None`` if the file was not compiled."""
+
+    duration: float = 0.0
+    """The time it took to compile the file and write the output, in seconds."""
+
+    error: Optional[Exception] = None
+    """The error that happened while compiling the file, if any."""
+
+
+class FileMonitor:
+    """Base class for objects that monitor a directory and report the files
+    in it that were added or modified.
+    """
+
+    root: str
+    """The directory being monitored."""
+
+    extensions: Tuple[str, ...]
+    """The extensions of the files that we are interested in, in lowercase,
+    including the leading dot.
+    """
+
+    def __init__(self, root: str, extensions: Iterable[str] = (".led",)):
+        """Constructor.
+
+        Parameters:
+            root: the directory to monitor, recursively
+            extensions: the extensions of the files to monitor
+        """
+        self.root = os.path.abspath(os.fspath(root))
+        self.extensions = tuple(ext.lower() for ext in extensions)
+
+    def close(self) -> None:
+        """Stops monitoring the directory and releases all resources held by
+        the monitor.
+        """
+        pass
+
+    def is_interesting(self, filename: str) -> bool:
+        """Returns whether the file with the given name should be monitored."""
+        return os.path.splitext(filename)[1].lower() in self.extensions
+
+    def scan(self) -> List[str]:
+        """Returns the names of all the files that are currently present in
+        the monitored directory and that we are interested in.
+        """
+        return sorted(path for path, _ in self._iter_files())
+
+    def wait_for_changes(self, timeout: Optional[float] = None) -> Set[str]:
+        """Waits until at least one file is added or modified in the monitored
+        directory, or until the given timeout expires.
+
+        Parameters:
+            timeout: the maximum number of seconds to wait; ``None`` means to
+                wait indefinitely
+
+        Returns:
+            the names of the files that were added or modified since the last
+            call to this method
+        """
+        raise NotImplementedError
+
+    def _iter_files(self) -> Iterable[Tuple[str, os.stat_result]]:
+        stack = [self.root]
+        while stack:
+            directory = stack.pop()
+            try:
+                entries = os.scandir(directory)
+            except OSError:
+                continue
+            with entries:
+                for entry in entries:
+                    try:
+                        if entry.is_dir():
+                            stack.append(entry.path)
+                        elif self.is_interesting(entry.name):
+                            yield entry.path, entry.stat()
+                    except OSError:
+                        # File disappeared while we were scanning
+                        pass
+
+
+class PollingFileMonitor(FileMonitor):
+    """File monitor that detects changes by scanning the monitored directory
+    periodically and comparing the modification times and sizes of the files.
+    """
+
+    interval: float
+    """Number of seconds between consecutive scans."""
+
+    _signatures: Dict[str, Tuple[int, int]]
+
+    def __init__(
+        self, root: str, extensions: Iterable[str] = (".led",), interval: float = 0.05
+    ):
+        """Constructor.
+
+        Parameters:
+            root: the directory to monitor, recursively
+            extensions: the extensions of the files to monitor
+            interval: number of seconds between consecutive scans
+        """
+        super().__init__(root, extensions)
+        self.interval = interval
+        self._signatures = self._collect_signatures()
+
+    def wait_for_changes(self, timeout: Optional[float] = None) -> Set[str]:
+        deadline = None if timeout is None else monotonic() + timeout
+        while True:
+            changes = self.poll()
+            if changes:
+                return changes
+
+            if deadline is None:
+                delay = self.interval
+            else:
+                delay = min(self.interval, deadline - monotonic())
+                if delay <= 0:
+                    return changes
+
+            Event().wait(delay)
+
+    def poll(self) -> Set[str]:
+        """Scans the monitored directory once and returns the names of the
+        files that were added or modified since the previous scan.
+        """
+        old_signatures = self._signatures
+        self._signatures = new_signatures = self._collect_signatures()
+        return {
+            path
+            for path, signature in new_signatures.items()
+            if old_signatures.get(path) != signature
+        }
+
+    def _collect_signatures(self) -> Dict[str, Tuple[int, int]]:
+        return {
+            path: (stat.st_mtime_ns, stat.st_size) for path, stat in self._iter_files()
+        }
+
+
+class WatchdogFileMonitor(FileMonitor):
+    """File monitor that relies on the notification mechanism of the operating
+    system, using the ``watchdog`` module.
+    """
+
+    _changes: Set[str]
+    _changed: Event
+    _lock: Lock
+
+    def __init__(self, root: str, extensions: Iterable[str] = (".led",)):
+        """Constructor.
+
+        Parameters:
+            root: the directory to monitor, recursively
+            extensions: the extensions of the files to monitor
+
+        Raises:
+            ImportError: if the ``watchdog`` module is not installed
+        """
+        from watchdog.events import FileSystemEventHandler
+        from watchdog.observers import Observer
+
+        super().__init__(root, extensions)
+
+        self._changes = set()
+        self._changed = Event()
+        self._lock = Lock()
+
+        monitor = self
+
+        class Handler(FileSystemEventHandler):
+            def on_any_event(self, event):
+                path = _get_changed_path(event)
+                if path is not None:
+                    monitor._notify(path)
+
+        self._observer = Observer()
+        self._observer.schedule(Handler(), self.root, recursive=True)
+        self._observer.start()
+
+    def close(self) -> None:
+        self._observer.stop()
+        self._observer.join()
+
+    def wait_for_changes(self, timeout: Optional[float] = None) -> Set[str]:
+        self._changed.wait(timeout)
+        with self._lock:
+            changes, self._changes = self._changes, set()
+            self._changed.clear()
+        return changes
+
+    def _notify(self, path: str) -> None:
+        if self.is_interesting(path):
+            with self._lock:
+                self._changes.add(path)
+                self._changed.set()
+
+
+_CHANGE_EVENT_TYPES = frozenset(("created", "modified", "moved"))
+"""Types of ``watchdog`` events that may change the contents of a file.
+Other events (e.g., files being opened or closed by the watcher itself or by
+a previewer) must be ignored, otherwise they would trigger recompilations.
+"""
+
+
+def _get_changed_path(event) -> Optional[str]:
+    """Returns the name of the file whose contents may have changed according
+    to the given ``watchdog`` event, or ``None`` if the event does not change
+    the contents of a file.
+    """
+    if event.is_directory or event.event_type not in _CHANGE_EVENT_TYPES:
+        return None
+    path = getattr(event, "dest_path", None) or event.src_path
+    return os.fsdecode(path)
+
+
+def create_file_monitor(
+    root: str, extensions: Iterable[str] = (".led",), *, polling: bool = False
+) -> FileMonitor:
+    """Creates a file monitor for the given directory, using the notification
+    mechanism of the operating system if possible and falling back to polling
+    otherwise.
+
+    Parameters:
+        root: the directory to monitor, recursively
+        extensions: the extensions of the files to monitor
+        polling: whether to force the usage of the polling file monitor
+    """
+    if not polling:
+        try:
+            return WatchdogFileMonitor(root, extensions)
+        except ImportError:
+            pass
+    return PollingFileMonitor(root, extensions)
+
+
+class Watcher:
+    """Object that watches a directory for changes and recompiles the source
+    files that were changed.
+
+    The watcher uses a single compiler instance for all the files so the
+    state of the compiler is kept warm between compilations. By default, the
+    compiler optimises the programs in independent, cached chunks to make
+    recompilation faster; the output plays back the same way but it may be
+    larger than the output of a compiler that optimises each program as a
+    whole. See ChunkedASTOptimiser_ for more details.
+    Files are recompiled only if their contents have changed since the last
+    compilation, and the outputs are written atomically so a previewer that
+    reads the output files never sees a partially written file.
+    """
+
+    compiler: BytecodeCompiler
+    """The compiler that compiles the changed files."""
+
+    debounce: float
+    """Number of seconds to wait for more changes after a change was
+    detected, before starting the compilation.
+    """
+
+    monitor: FileMonitor
+    """The file monitor that detects the changes."""
+
+    output_format: OutputFormat
+    """The output format of the compiler."""
+
+    _digests: Dict[str, bytes]
+
+    def __init__(
+        self,
+        monitor: FileMonitor,
+        *,
+        optimisation_level: int = 2,
+        output_format: OutputFormat = OutputFormat.LEDCTRL_BINARY,
+        debounce: float = 0.02,
+        chunked: bool = True,
+    ):
+        """Constructor.
+
+        Parameters:
+            monitor: the file monitor that detects the changes
+            optimisation_level: the optimisation level of the compiler
+            output_format: the output format of the compiler
+            debounce: number of seconds to wait for more changes after a
+                change was detected, before starting the compilation
+            chunked: whether the compiler should use approximate, chunked
+                optimisation to make recompilation faster. When it is
+                ``False``, the outputs are the same as the outputs of a
+                compiler that optimises each program as a whole.
+        """
+        self.monitor = monitor
+        self.compiler = BytecodeCompiler(
+            optimisation_level=optimisation_level, chunked=chunked
+        )
+        self.output_format = OutputFormat(output_format)
+        self.debounce = debounce
+        self._digests = {}
+
+    def get_output_filename(self, input: str) -> str:
+        """Returns the name of the output file corresponding to the given
+        input file.
+        """
+        if self.output_format is OutputFormat.LEDCTRL_JSON:
+            extension = ".json"
+        elif self.output_format is OutputFormat.LEDCTRL_SOURCE:
+            extension = ".oled"
+        else:
+            extension = ".bin"
+        return os.path.splitext(input)[0] + extension
+
+    def compile_files(self, inputs: Iterable[str]) -> List[WatchResult]:
+        """Compiles the given input files if their contents have changed
+        since the last time they were compiled.
+
+        Parameters:
+            inputs: the names of the input files
+
+        Returns:
+            the results of the compilation, one for each input file that was
+            actually compiled
+        """
+        results = []
+        for input in sorted(inputs):
+            result = self._compile_file(input)
+            if result is not None:
+                results.append(result)
+        return results
+
+    def compile_outdated_files(self) -> List[WatchResult]:
+        """Compiles all the files in the monitored directory whose output
+        file is missing or older than the input file.
+        """
+        to_compile = []
+        for input in self.monitor.scan():
+            output = self.get_output_filename(input)
+            try:
+                outdated = os.path.getmtime(output) < os.path.getmtime(input)
+            except OSError:
+                outdated = True
+            if outdated:
+                to_compile.append(input)
+            else:
+                # Remember the current contents of the file so we do not
+                # recompile it needlessly if it is touched without changes
+                digest = self._get_digest(input)
+                if digest is not None:
+                    self._digests[input] = digest
+        return self.compile_files(to_compile)
+
+    def run(
+        self,
+        callback: Callable[[WatchResult], None],
+        *,
+        stop: Optional[Event] = None,
+        poll_timeout: float = 0.5,
+    ) -> None:
+        """Watches the monitored directory and compiles the changed files
+        until the given stop event is set.
+
+        Parameters:
+            callback: function to call with the result of each compilation
+            stop: event that stops the watcher when set; ``None`` means to
+                watch indefinitely
+            poll_timeout: maximum number of seconds to wait for changes before
+                checking the stop event again
+        """
+        while stop is None or not stop.is_set():
+            changes = self.monitor.wait_for_changes(poll_timeout)
+            if not changes:
+                continue
+
+            # Debounce: editors often write a file in multiple steps, so
+            # wait until the changes settle down
+            while self.debounce > 0:
+                more_changes = self.monitor.wait_for_changes(self.debounce)
+                if not more_changes:
+                    break
+                changes.update(more_changes)
+
+            for result in self.compile_files(changes):
+                callback(result)
+
+    def _compile_file(self, input: str) -> Optional[WatchResult]:
+        started_at = perf_counter()
+
+        try:
+            with open(input, "rb") as fp:
+                data = fp.read()
+        except OSError:
+            # File disappeared in the meanwhile
+            self._digests.pop(input, None)
+            return None
+
+        digest = blake2b(data, digest_size=16).digest()
+        if self._digests.get(input) == digest:
+            return None
+
+        output = self.get_output_filename(input)
+        try:
+            (result,) = self.compiler.compile(
+                data, input_format="ledctrl_source", output_format=self.output_format
+            )
+            write_file_atomically(output, result)
+        except Exception as ex:
+            # Forget the digest so the file is compiled again even if the
+            # user reverts it to its last successfully compiled state
+            self._digests.pop(input, None)
+            return WatchResult(
+                input=input, duration=perf_counter() - started_at, error=ex
+            )
+
+        self._digests[input] = digest
+        return WatchResult(
+            input=input, output=output, duration=perf_counter() - started_at
+        )
+
+    @staticmethod
+    def _get_digest(input: str) -> Optional[bytes]:
+        try:
+            with open(input, "rb") as fp:
+                return blake2b(fp.read(), digest_size=16).digest()
+        except OSError:
+            return None
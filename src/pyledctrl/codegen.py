@@ -0,0 +1,211 @@
+"""Ahead-of-time specialization of light programs into generated Python
+functions.
+
+A player answers queries by searching the events of the light program and
+interpreting the segment that it finds. For light programs that are queried
+a very large number of times, this module can turn the flattened timeline of
+the light program into the source code of a dedicated Python function: a
+balanced tree of comparisons over the boundaries of the segments, with the
+timestamps and colors of each segment inlined as constants. The function is
+compiled once and cached by the hash of the bytecode of the light program.
+"""
+
+from hashlib import sha256
+from math import isfinite
+from threading import Lock
+from typing import Callable, Dict, List, Tuple, Union
+
+from .executor import Color, ExecutorState
+from .parsers.bytecode import Buffer
+from .player import Player
+
+__all__ = ("Evaluator", "clear_cache", "compile_evaluator", "generate_source")
+
+
+Evaluator = Callable[[float], Color]
+"""Type alias for generated functions that return the color of a light
+program at a given timestamp.
+"""
+
+_cache: Dict[str, Evaluator] = {}
+_cache_lock = Lock()
+
+
+def _get_events(bytecode: bytes) -> List[ExecutorState]:
+    """Executes the given light program until its end and returns all its
+    events, including the sentinel events at the start and at the end.
+
+    Raises:
+        ValueError: if the light program never ends
+    """
+    player = Player.from_bytes(bytecode)
+    if player.is_infinite:
+        raise ValueError(
+            "light program never ends; use a Player to evaluate it instead"
+        )
+
+    log = player._log
+    log.extend_beyond(float("inf"))
+    return log.events
+
+
+class _SourceBuilder:
+    """Helper object that generates the source code of an evaluator from the
+    events of a light program.
+    """
+
+    def __init__(self, events: List[ExecutorState]):
+        self._events = events
+        self._lines: List[str] = []
+        self._constants: Dict[Color, str] = {}
+
+        # Queries are answered from the segment that starts at the last event
+        # that is not later than the timestamp, so events with the same
+        # timestamp are represented by the last of them. The first segment
+        # (from the sentinel before zero time) also covers all the earlier
+        # timestamps, and the last one (from the last event to the sentinel
+        # at infinity) covers all the later ones.
+        boundaries: Dict[float, int] = {}
+        for index in range(1, len(events) - 1):
+            boundaries[events[index].timestamp] = index
+        self._boundaries: List[Tuple[float, int]] = sorted(boundaries.items())
+
+    def build(self, name: str) -> Tuple[str, Dict[str, object]]:
+        self._lines = ["def {0}(t):".format(name)]
+        self._emit_tree(0, len(self._boundaries), 0, 1)
+        namespace: Dict[str, object] = {
+            "_Color": Color,
+            "_new": tuple.__new__,
+            "_isfinite": isfinite,
+        }
+        for color, constant in self._constants.items():
+            namespace[constant] = color
+        return "\n".join(self._lines) + "\n", namespace
+
+    def _constant(self, color: Color) -> str:
+        constant = self._constants.get(color)
+        if constant is None:
+            constant = self._constants[color] = "_c{0}".format(len(self._constants))
+        return constant
+
+    def _emit(self, depth: int, line: str) -> None:
+        self._lines.append("    " * depth + line)
+
+    def _emit_tree(self, lo: int, hi: int, index: int, depth: int) -> None:
+        """Emits the comparison tree that handles regions ``lo`` to ``hi``
+        (inclusive) of the time axis, where region *k* spans from boundary
+        *k* - 1 (inclusive) to boundary *k* (exclusive), and ``index`` is
+        the index of the event that starts region ``lo``.
+        """
+        if lo == hi:
+            self._emit_leaf(
+                index, depth, first=lo == 0, last=lo == len(self._boundaries)
+            )
+            return
+
+        mid = (lo + hi + 1) // 2
+        timestamp, mid_index = self._boundaries[mid - 1]
+        self._emit(depth, "if t < {0!r}:".format(timestamp))
+        self._emit_tree(lo, mid - 1, index, depth + 1)
+        self._emit(depth, "else:")
+        self._emit_tree(mid, hi, mid_index, depth + 1)
+
+    def _emit_leaf(self, index: int, depth: int, first: bool, last: bool) -> None:
+        """Emits the code that returns the color of the segment starting at
+        the event with the given index.
+        """
+        if first or last:
+            # Infinite timestamps and NaN end up in the outermost segments
+            self._emit(depth, "if not _isfinite(t):")
+            self._emit(
+                depth + 1, 'raise ValueError("infinite timestamp not supported")'
+            )
+
+        start, end = self._events[index], self._events[index + 1]
+        if not end.is_fade:
+            self._emit(depth, "return {0}".format(self._constant(start.color)))
+            return
+
+        # Same floating-point operations as Color.mix_with() in the player
+        diff = end.timestamp - start.timestamp
+        self._emit(depth, "ratio = (t - {0!r}) / {1!r}".format(start.timestamp, diff))
+        if first:
+            self._emit(depth, "if ratio <= 0:")
+            self._emit(depth + 1, "return {0}".format(self._constant(start.color)))
+        self._emit(depth, "rest = 1 - ratio")
+
+        channels = [
+            # Mixing a value with itself always rounds back to the same value
+            str(x) if x == y else "round({0} * rest + {1} * ratio)".format(x, y)
+            for x, y in zip(start.color, end.color)
+        ]
+        self._emit(depth, "return _new(_Color, ({0}))".format(", ".join(channels)))
+
+
+def generate_source(
+    program: Union[Buffer, Player], name: str = "evaluate"
+) -> Tuple[str, Dict[str, object]]:
+    """Generates the source code of a function that returns the color of the
+    given light program at a given timestamp, in seconds.
+
+    The generated function returns exactly the same colors as
+    ``Player.get_color_at()`` for all timestamps.
+
+    Parameters:
+        program: the light program in compiled bytecode format, or a player
+            of the light program
+        name: the name of the generated function
+
+    Returns:
+        the source code of the function and the global namespace that the
+        source code needs to be executed in
+
+    Raises:
+        ValueError: if the light program never ends because it contains an
+            infinite loop; such light programs have no finite timeline to
+            specialize
+    """
+    bytecode = program.to_bytes() if isinstance(program, Player) else bytes(program)
+    return _SourceBuilder(_get_events(bytecode)).build(name)
+
+
+def compile_evaluator(program: Union[Buffer, Player]) -> Evaluator:
+    """Returns a compiled function that returns the color of the given light
+    program at a given timestamp, in seconds.
+
+    The function is generated with ``generate_source()`` when it is first
+    needed and it is cached by the hash of the bytecode of the light program,
+    so light programs with the same bytecode share the same function.
+    Generating the function requires executing the light program until its
+    end, so it pays off only for light programs that are queried many times.
+
+    Parameters:
+        program: the light program in compiled bytecode format, or a player
+            of the light program
+
+    Raises:
+        ValueError: if the light program never ends because it contains an
+            infinite loop
+    """
+    bytecode = program.to_bytes() if isinstance(program, Player) else bytes(program)
+    digest = sha256(bytecode).hexdigest()
+
+    evaluator = _cache.get(digest)
+    if evaluator is not None:
+        return evaluator
+
+    source, namespace = generate_source(bytecode)
+    code = compile(source, "<ledctrl evaluator {0}>".format(digest[:12]), "exec")
+    exec(code, namespace)
+    evaluator = namespace["evaluate"]  # type: ignore
+
+    with _cache_lock:
+        return _cache.setdefault(digest, evaluator)  # type: ignore
+
+
+def clear_cache() -> None:
+    """Removes all the compiled functions from the cache of
+    ``compile_evaluator()``.
+    """
+    with _cache_lock:
+        _cache.clear()
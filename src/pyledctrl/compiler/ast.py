@@ -99,10 +99,13 @@ from typing import (
 )
 from warnings import warn
 
-from pyledctrl.utils import first, to_varuint
+from pyledctrl.utils import first
+from pyledctrl.varuint import encode_varuint, read_varuint
 
 from .colors import Color
+from .cost import loop_cost, statements_cost
 from .errors import BytecodeParserError, BytecodeParserEOFError
+from .writer import LEDSourceWriter
 
 
 class CommandCode:
@@ -378,6 +381,19 @@ class Node(object, metaclass=_NodeMeta):
         """
         raise NotImplementedError
 
+    def write_led_source(self, writer: LEDSourceWriter) -> None:
+        """Writes the ``.led`` source format representation of the node into
+        the given writer.
+
+        The default implementation writes the result of ``to_led_source()``;
+        nodes that contain other statements should override it to write
+        their children one by one instead.
+
+        Parameters:
+            writer: the writer to write the source code into
+        """
+        writer.write(self.to_led_source())
+
     def transform_child_nodes(self) -> Generator["Node", Optional["Node"], None]:
         """Returns a generator that yields all field values that are subclasses
         of nodes and allows the user to replace the nodes with transformed ones
@@ -526,25 +542,14 @@ class Varuint(Literal):
         Returns:
             the constructed object
         """
-        value = 0
-        shift = 0
-        while True:
-            x = data.read(1)
-            if not x:
-                raise BytecodeParserEOFError(cls)
-
-            x = ord(x)
-            value |= (x & 0x7F) << shift
-            shift += 7
-
-            if x < 128:
-                break
-
-        return cls(value)
+        try:
+            return cls(read_varuint(data))
+        except EOFError:
+            raise BytecodeParserEOFError(cls) from None
 
     def __init__(self, value=0):
         self._set_value(int(value))
-        self._bytecode = to_varuint(value)
+        self._bytecode = encode_varuint(value)
 
     def equals(self, other: "Varuint"):
         """Compares this varuint with another varuint to decide whether they
@@ -799,8 +804,21 @@ class Duration(Varuint):
     _fields = Varuint._fields
     _instance_cache: ClassVar[Dict[int, "Duration"]] = {}
 
+    _CACHE_LIMIT: ClassVar[int] = 2**14
+    """Durations shorter than this number of frames are cached and shared by
+    ``from_frames()``; longer ones are rare enough that caching them would
+    only make the cache grow without bounds in long-running processes.
+    """
+
     FPS: ClassVar[Decimal] = Decimal(50)
 
+    _seconds_cache: ClassVar[Dict[Union[int, float], "Duration"]] = {}
+    _seconds_cache_fps: ClassVar[Optional[Decimal]] = None
+    _seconds_cache_fps_ratio: ClassVar[Tuple[int, int]] = (50, 1)
+
+    _SECONDS_CACHE_SIZE: ClassVar[int] = 4096
+    """Maximum number of entries in the cache of ``from_seconds()``."""
+
     def __init__(self, value: int = 0):
         # Don't remove this constructor -- it prevents NodeMeta from generating
         # one for Duration
@@ -811,11 +829,86 @@ class Duration(Varuint):
         result = cls._instance_cache.get(frames)
         if result is None:
             result = cls(value=frames)
-            cls._instance_cache[frames] = result
+            if frames < cls._CACHE_LIMIT:
+                cls._instance_cache[frames] = result
         return result
 
     @classmethod
     def from_seconds(cls, seconds: float):
+        if seconds is None:
+            seconds = 0
+
+        # Fast path for integers and floats. This path handles only the
+        # conversions that are exact; everything else (including the
+        # rounding and the warning for inexact conversions) is left to the
+        # reference implementation below so the results are always the same
+        seconds_type = type(seconds)
+        if seconds_type is float or seconds_type is int:
+            if cls._seconds_cache_fps is not cls.FPS:
+                cls._reset_seconds_cache()
+
+            result = cls._seconds_cache.get(seconds)
+            if result is not None:
+                return result
+
+            frames = cls._get_exact_frame_count(seconds)
+            if frames is not None and frames >= 0:
+                result = cls.from_frames(frames)
+                cache = cls._seconds_cache
+                if len(cache) >= cls._SECONDS_CACHE_SIZE:
+                    cache.clear()
+                cache[seconds] = result
+                return result
+
+        return cls._from_seconds_with_decimals(seconds)
+
+    @classmethod
+    def _get_exact_frame_count(cls, seconds: Union[int, float]) -> Optional[int]:
+        """Returns the number of frames corresponding to the given number of
+        seconds if the conversion is exact, using the same interpretation of
+        floats as the reference implementation (i.e. the shortest decimal
+        representation of the float), or ``None`` if the conversion is not
+        exact.
+        """
+        numerator, denominator = cls._seconds_cache_fps_ratio
+        if type(seconds) is int:
+            numerator *= seconds
+        else:
+            text = repr(seconds)
+            mantissa, _, exponent_str = text.partition("e")
+            integer_part, _, fraction_part = mantissa.partition(".")
+            try:
+                digits = int(integer_part + fraction_part)
+                exponent = int(exponent_str) if exponent_str else 0
+            except ValueError:
+                # inf or nan
+                return None
+
+            exponent -= len(fraction_part)
+            numerator *= digits
+            if exponent >= 0:
+                numerator *= 10**exponent
+            else:
+                denominator *= 10**-exponent
+
+        frames, remainder = divmod(numerator, denominator)
+        return None if remainder else frames
+
+    @classmethod
+    def _reset_seconds_cache(cls) -> None:
+        """Clears the cache of ``from_seconds()``; called when the frame rate
+        changes.
+        """
+        fps = cls.FPS
+        cls._seconds_cache = {}
+        cls._seconds_cache_fps_ratio = Decimal(fps).as_integer_ratio()
+        cls._seconds_cache_fps = fps
+
+    @classmethod
+    def _from_seconds_with_decimals(cls, seconds: float):
+        """Reference implementation of ``from_seconds()`` that uses decimal
+        arithmetic.
+        """
         # Okay, this is tricky. First of all, multiplication between a
         # Decimal and a float is not supported, so we need to convert
         # float seconds into Decimal as well. However, check this:
@@ -829,9 +922,6 @@ class Duration(Varuint):
         # But we can cast the float value into a string, which rounds it off
         # nicely, and then we can pass it to the Decimal() constructor.
 
-        if seconds is None:
-            seconds = 0
-
         seconds_as_str = Decimal(str(seconds))
         frame_count = seconds_as_str * cls.FPS
         getcontext().clear_flags()
@@ -855,7 +945,7 @@ class Duration(Varuint):
         return self.value / self.FPS
 
     def to_bytecode(self):
-        return to_varuint(int(self.value))
+        return encode_varuint(int(self.value))
 
     def to_led_source(self):
         return str(self.value_in_seconds)
@@ -896,13 +986,25 @@ class StatementSequence(Node):
 
     @Node.length_in_bytes.getter
     def length_in_bytes(self):
-        return sum(node.length_in_bytes for node in self.statements)
+        return statements_cost(self.statements)
 
     def to_bytecode(self):
         return b"".join(node.to_bytecode() for node in self.statements)
 
     def to_led_source(self):
-        return "\n".join(statement.to_led_source() for statement in self.statements)
+        writer = LEDSourceWriter()
+        self.write_led_source(writer)
+        return writer.getvalue()
+
+    def __reduce__(self):
+        return _reduce_statement(self)
+
+    def write_led_source(self, writer: LEDSourceWriter) -> None:
+        write = writer.write
+        for index, statement in enumerate(self.statements):
+            if index:
+                write("\n")
+            statement.write_led_source(writer)
 
 
 class Statement(Node):
@@ -926,6 +1028,9 @@ class Statement(Node):
         """
         return self.to_bytecode() == other.to_bytecode()
 
+    def __reduce__(self):
+        return _reduce_statement(self)
+
 
 class Comment(Statement):
     """Node that represents a comment (i.e. a string that appears in the
@@ -1312,13 +1417,9 @@ class LoopBlock(Statement):
 
     @Node.length_in_bytes.getter
     def length_in_bytes(self):
-        if not self.body.statements or self.iterations.value <= 0:
+        if not self.body.statements or self.iterations.value < 0:
             return 0
-        body_length = sum(node.length_in_bytes for node in self.body.statements)
-        if self.iterations.value == 1:
-            return body_length
-        else:
-            return body_length + 2 + self.iterations.length_in_bytes
+        return loop_cost(self.iterations.value, statements_cost(self.body.statements))
 
     def to_bytecode(self):
         if not self.body.statements or self.iterations.value < 0:
@@ -1336,15 +1437,21 @@ class LoopBlock(Statement):
             )
 
     def to_led_source(self):
+        writer = LEDSourceWriter()
+        self.write_led_source(writer)
+        return writer.getvalue()
+
+    def write_led_source(self, writer: LEDSourceWriter) -> None:
         if not self.body.statements or self.iterations.value < 0:
-            return ""
+            return
 
-        body = self.body.to_led_source()
         if self.iterations.value == 1:
-            return body
+            self.body.write_led_source(writer)
         else:
-            body = body.replace("\n", "\n    ")
-        return "with loop(iterations={0}):\n    {1}".format(self.iterations, body)
+            writer.write("with loop(iterations={0}):".format(self.iterations))
+            with writer.indented():
+                writer.write("\n")
+                self.body.write_led_source(writer)
 
 
 class NodeVisitor(Generic[T]):
@@ -1457,6 +1564,20 @@ iter_field_values = Node.iter_field_values
 iter_child_nodes = Node.iter_child_nodes
 
 
+#############################################################################
+# Helper functions for pickling
+
+
+def _reduce_statement(node: Node):
+    """Implementation of ``__reduce__()`` for statements and statement
+    sequences that pickles them in the compact serialized format provided by
+    the ``serialization`` module.
+    """
+    from .serialization import dump_ast, load_ast
+
+    return load_ast, (dump_ast(node),)
+
+
 #############################################################################
 # Helper functions for parsing
 
@@ -0,0 +1,251 @@
+"""Approximate, chunked optimisation of abstract syntax trees.
+
+Optimising a long light program is the most expensive part of the compilation.
+When the program is edited and compiled again, most of it is typically
+unchanged, so it is wasteful to optimise the entire program from scratch.
+
+The optimiser in this module trades some of the quality of the optimisation
+for speed. It splits the top-level statement sequence of the program into
+chunks at content-defined boundaries. Chunk boundaries are placed after
+statements whose hash satisfies a certain condition, so an edit affects the
+chunk that contains it (and occasionally the next one) but the remaining
+chunks stay the same. Each chunk is optimised on its own and the optimised
+chunks are cached by the hash of their contents; when any program is
+compiled again, the chunks that are found in the cache are not optimised
+again. This is a cache keyed by the contents of the chunks, not a diff
+against the previous compilation.
+
+Since the chunks are optimised independently, commands are not merged and
+loops are not detected across chunk boundaries. The output of the optimiser
+is therefore *not* the same as the output of the wrapped optimiser run on the
+entire program: the bytecode may differ and it may be larger. Use it where a
+quick, slightly larger result is acceptable (e.g., for previews while a light
+program is being edited) and compile the final bytecode without it.
+
+Optimisations that need to see the entire program cannot be applied to the
+chunks independently: the conversion of ``wait_until()`` commands into sleeps
+depends on the absolute time when a chunk starts, and color quantisation
+depends on the colors of the entire program. These are run once on the
+entire program before it is split into chunks; see the
+``whole_program_optimiser`` argument of the optimiser.
+
+The chunked optimiser guarantees the following:
+
+- its output is always the same as the output of a *fresh* chunked optimiser
+  with the same settings, no matter what was compiled before;
+
+- its output produces the same sequence of colors at the same timestamps
+  as the output of the wrapped optimiser run on the entire program, as long
+  as the timing tolerance of loop detection is zero. With a positive timing
+  tolerance, both outputs stay within the tolerance of the original program
+  but they may deviate from it differently.
+
+Only the optimisation of the cached chunks is saved; the whole-program
+optimisations and the splitting of the program into chunks still take time
+proportional to the length of the program, so recompiling a long program
+still takes a noticeable amount of time.
+"""
+
+from collections import OrderedDict
+from hashlib import blake2b
+from typing import Iterable, List, Optional, Tuple
+from zlib import crc32
+
+from .ast import Command, Node, NodeList, StatementSequence
+from .optimisation import ASTOptimiser
+from .serialization import dump_ast, load_ast
+
+__all__ = ("ChunkedASTOptimiser",)
+
+
+class ChunkedASTOptimiser(ASTOptimiser):
+    """AST optimiser that wraps another optimiser and optimises the top-level
+    statement sequence of an AST in independent, cached chunks. The result
+    is an approximation of the output of the wrapped optimiser; see the
+    documentation of the module for the details.
+
+    Optimised chunks are cached in their serialized form (see ``dump_ast()``)
+    so each returned abstract syntax tree has its own copy of the statements
+    and it may be modified freely after the optimisation.
+    """
+
+    min_chunk_length: int
+    """Minimum number of statements in a chunk. Loops are not detected across
+    chunk boundaries so this should be large enough to contain a few
+    iterations of any loop that we are likely to encounter.
+    """
+
+    max_chunk_length: int
+    """Maximum number of statements in a chunk."""
+
+    boundary_divisor: int
+    """Controls the expected number of statements between a chunk boundary
+    and the earliest position where the next chunk boundary may appear.
+    """
+
+    max_cache_size: int
+    """Maximum number of optimised chunks to keep in the cache."""
+
+    hits: int
+    """Number of chunks that were found in the cache during the last
+    optimisation.
+    """
+
+    misses: int
+    """Number of chunks that had to be optimised during the last
+    optimisation.
+    """
+
+    _cache: "OrderedDict[bytes, Tuple[bytes, bool]]"
+    _optimiser: ASTOptimiser
+    _whole_program_optimiser: Optional[ASTOptimiser]
+
+    def __init__(
+        self,
+        optimiser: ASTOptimiser,
+        *,
+        whole_program_optimiser: Optional[ASTOptimiser] = None,
+        min_chunk_length: int = 256,
+        max_chunk_length: int = 4096,
+        boundary_divisor: int = 256,
+        max_cache_size: int = 65536,
+    ):
+        """Constructor.
+
+        Parameters:
+            optimiser: the optimiser that optimises the individual chunks
+            whole_program_optimiser: optional optimiser that is run on the
+                entire AST before it is split into chunks. Optimisers that
+                need to see the entire program (e.g., the conversion of
+                ``wait_until()`` commands into sleeps or color quantisation)
+                must be run here and not on the individual chunks.
+            min_chunk_length: minimum number of statements in a chunk
+            max_chunk_length: maximum number of statements in a chunk
+            boundary_divisor: controls the expected number of statements
+                between the minimum length of a chunk and its boundary
+            max_cache_size: maximum number of optimised chunks to keep in
+                the cache
+        """
+        self._optimiser = optimiser
+        self._whole_program_optimiser = whole_program_optimiser
+        self._cache = OrderedDict()
+
+        self.min_chunk_length = max(1, int(min_chunk_length))
+        self.max_chunk_length = max(self.min_chunk_length, int(max_chunk_length))
+        self.boundary_divisor = max(1, int(boundary_divisor))
+        self.max_cache_size = max(0, int(max_cache_size))
+
+        self.hits = self.misses = 0
+
+    def clear(self) -> None:
+        """Clears the cache of the optimiser."""
+        self._cache.clear()
+
+    def optimise_ast(self, ast: Node) -> bool:
+        changed = False
+        if self._whole_program_optimiser is not None:
+            changed = self._whole_program_optimiser.optimise(ast)
+
+        if not isinstance(ast, StatementSequence):
+            return self._optimiser.optimise(ast) or changed
+
+        self.hits = self.misses = 0
+
+        result = NodeList()
+
+        for chunk in self._split_into_chunks(ast.statements):
+            key = self._get_chunk_key(chunk)
+            entry = self._cache.get(key)
+            if entry is None:
+                self.misses += 1
+                sequence = StatementSequence(NodeList(chunk))
+                chunk_changed = self._optimiser.optimise(sequence)
+                self._store(key, sequence, chunk_changed)
+            else:
+                self.hits += 1
+                self._cache.move_to_end(key)
+                data, chunk_changed = entry
+                sequence = load_ast(data)  # type: ignore
+
+            result.extend(sequence.statements)
+            changed = changed or chunk_changed
+
+        ast.statements[:] = result
+        return changed
+
+    def _store(self, key: bytes, sequence: StatementSequence, changed: bool) -> None:
+        """Stores an optimised chunk in the cache."""
+        if self.max_cache_size <= 0:
+            return
+
+        try:
+            data = dump_ast(sequence)
+        except TypeError:
+            # Chunk contains nodes that cannot be serialized; do not cache it
+            return
+
+        self._cache[key] = data, changed
+        if len(self._cache) > self.max_cache_size:
+            self._cache.popitem(last=False)
+
+    @staticmethod
+    def _get_chunk_key(chunk: "_Chunk") -> bytes:
+        """Returns the cache key of a chunk, derived from the keys of the
+        statements in the chunk.
+        """
+        hasher = blake2b(digest_size=16)
+        for key in chunk.keys:
+            hasher.update(len(key).to_bytes(4, "little"))
+            hasher.update(key)
+        return hasher.digest()
+
+    @staticmethod
+    def _get_statement_key(statement: Node) -> bytes:
+        """Returns a byte string that identifies the given statement uniquely
+        for the purposes of caching.
+        """
+        if isinstance(statement, Command):
+            # Command codes are all below 0x20 so they cannot be confused
+            # with the keys of other node types
+            return statement.to_bytecode()
+        else:
+            # Comments and loop blocks may contain parts that do not show up
+            # in the bytecode
+            return b"\xff%s\x00%s" % (
+                statement.__class__.__name__.encode("ascii"),
+                statement.to_led_source().encode("utf-8"),
+            )
+
+    def _split_into_chunks(self, statements: List[Node]) -> Iterable["_Chunk"]:
+        """Splits the given list of statements into chunks at content-defined
+        boundaries.
+        """
+        min_length, max_length = self.min_chunk_length, self.max_chunk_length
+        divisor = self.boundary_divisor
+        get_key = self._get_statement_key
+
+        chunk = _Chunk()
+        for statement in statements:
+            key = get_key(statement)
+            chunk.append(statement)
+            chunk.keys.append(key)
+
+            length = len(chunk)
+            if length >= min_length and (
+                length >= max_length or crc32(key) % divisor == 0
+            ):
+                yield chunk
+                chunk = _Chunk()
+
+        if chunk:
+            yield chunk
+
+
+class _Chunk(List[Node]):
+    """List of statements that also stores the keys of the statements."""
+
+    keys: List[bytes]
+
+    def __init__(self):
+        super().__init__()
+        self.keys = []
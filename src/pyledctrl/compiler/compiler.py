@@ -4,12 +4,37 @@ from input files in various formats.
 
 import os
 
+from mmap import ACCESS_READ, mmap
 from pathlib import Path
-from typing import Any, Dict, Optional, Tuple, Type
+from typing import (
+    Any,
+    Callable,
+    IO,
+    Dict,
+    Iterable,
+    Iterator,
+    Optional,
+    Tuple,
+    Type,
+    Union,
+    overload,
+)
+
+from pyledctrl.parsers.bytecode import BUFFER_TYPES
+from pyledctrl.utils import write_file_atomically
 
 from .errors import CompilerError, UnsupportedInputFormatError
 from .formats import InputFormat, InputFormatLike, OutputFormat, OutputFormatLike
-from .optimisation import create_optimiser_for_level
+from .chunked import ChunkedASTOptimiser
+from .json_stream import iter_json_programs
+from .optimisation import (
+    ASTOptimiser,
+    ChainedASTOptimiser,
+    ColorQuantisationReport,
+    ColorQuantiser,
+    create_absolute_time_optimiser_for_level,
+    create_optimiser_for_level,
+)
 from .plan import Plan
 from .stages import (
     ASTObjectToBytecodeCompilationStage,
@@ -36,9 +61,15 @@ class BytecodeCompiler:
     _output_format_to_output_stage_factory: Dict[
         OutputFormat, Type[ASTObjectToRawBytesCompilationStage]
     ]
+    _color_quantiser: Optional[ColorQuantiser]
+    _color_tolerance: int
     _optimisation_level: int
+    _optimiser: Optional[ASTOptimiser]
+    _timing_tolerance: int
 
     environment: CompilationStageExecutionEnvironment
+    chunked: bool
+    map_files: bool
     progress: bool
     verbose: bool
 
@@ -46,6 +77,10 @@ class BytecodeCompiler:
         self,
         *,
         optimisation_level: int = 0,
+        chunked: bool = False,
+        color_tolerance: int = 0,
+        timing_tolerance: int = 0,
+        map_files: bool = False,
         progress: bool = False,
         verbose: bool = False
     ):
@@ -54,12 +89,41 @@ class BytecodeCompiler:
         Parameters:
             optimisation_level: the optimisation level that the compiler
                 will use. Defaults to not optimising the bytecode at all.
+            chunked: whether to optimise programs in independent, cached
+                chunks. Recompiling an edited program is faster in chunked
+                mode because the compiler optimises only the chunks that are
+                not in the cache, but the optimisation is approximate: the
+                bytecode plays back the same way but it is not the same as
+                the bytecode of a compiler without chunked mode and it may be
+                larger. See ChunkedASTOptimiser_ for more details.
+            color_tolerance: maximum difference allowed between the original
+                and the optimised value of a color channel. When positive,
+                nearly identical colors of the program are replaced with a
+                shared representative color before the other optimisations
+                so more commands can be merged and more loops can be
+                detected. See ColorQuantiser_ for more details. Zero means
+                that colors are never changed.
+            timing_tolerance: maximum number of frames by which the durations
+                of the commands in different iterations of a loop may differ
+                when the optimiser detects loops. See LoopDetector_ for more
+                details. Zero means that loops are detected only if their
+                iterations are exactly identical.
+            map_files: whether to map input files into memory instead of
+                reading them. Mapping avoids copying large input files into
+                memory; it is most useful when input files are large or when
+                only parts of them are used.
             progress: whether to print a progress bar showing the
                 progress of the compilation
             verbose: whether to print additional messages about the compilation
                 process above the progress bar
         """
+        self._color_quantiser = None
+        self._color_tolerance = 0
         self._optimisation_level = 0
+        self._optimiser = None
+        self._timing_tolerance = 0
+        self.chunked = bool(chunked)
+        self.map_files = bool(map_files)
 
         self._input_format_to_ast_stage_factory = {
             InputFormat.LEDCTRL_BINARY: BytecodeToASTObjectCompilationStage,
@@ -73,6 +137,8 @@ class BytecodeCompiler:
         }
 
         self.optimisation_level = int(optimisation_level)
+        self.color_tolerance = int(color_tolerance)
+        self.timing_tolerance = int(timing_tolerance)
         self.progress = progress
         self.verbose = verbose
 
@@ -92,8 +158,10 @@ class BytecodeCompiler:
         Parameters:
             input: the input to compile. When it is a string or a Path object, it is
                 assumed to be the name of a file that contains the input. When it is
-                a bytes object, it is assumed to contain the raw data to compile;
-                in this case, the ``input_format`` parameter must be specified.
+                a bytes-like object (bytes, bytearray, memoryview or mmap), it is
+                assumed to contain the raw data to compile; in this case, the
+                ``input_format`` parameter must be specified. Compiled bytecode
+                in such buffers is parsed without copying the buffer.
                 When it is a dictionary, it is assumed to be the Python
                 representation of a JSON object and the ``input_format`` will
                 be assumed to be ``InputFormat.LEDCTRL_JSON``.
@@ -116,32 +184,7 @@ class BytecodeCompiler:
         Raises:
             CompilerError: in case of a compilation error
         """
-        if isinstance(input, Path):
-            input = str(input)
-
-        if isinstance(input, str):
-            if input_format is None:
-                input_format = InputFormat.detect_from_filename(input)
-
-            description = os.path.basename(input)
-            with open(input, "rb") as fp:
-                input = fp.read()
-
-        elif isinstance(input, bytes):
-            description = "<<raw bytes>>"
-
-        elif isinstance(input, dict):
-            from json import dumps
-
-            description = "<<JSON>>"
-            input = dumps(input).encode("utf-8")
-            input_format = InputFormat.LEDCTRL_JSON
-
-        else:
-            description = "<<unknown>>"
-
-        if input_format is None:
-            raise CompilerError("input format must be specified")
+        data, input_format, description = self._prepare_input(input, input_format)
 
         if output_format is None:
             if output_file is not None:
@@ -149,23 +192,193 @@ class BytecodeCompiler:
             else:
                 output_format = OutputFormat.AST
 
-        input_format = InputFormat(input_format)
         output_format = OutputFormat(output_format)
 
-        plan = Plan()
-        self._collect_stages(plan, input, input_format, output_format)
-        self.output = plan.execute(
-            self.environment,
-            force=True,
-            progress=self.progress,
-            description=description,
-            verbose=self.verbose,
-        )
+        try:
+            self.output = self._execute_plan(
+                data,
+                input_format,
+                output_format,
+                description=description,
+                progress=self.progress,
+            )
+        finally:
+            if data is not input:
+                _release_input_data(data)
         if output_file:
             self._write_outputs_to_file(self.output, output_file)
 
         return self.output
 
+    @overload
+    def compile_many(
+        self,
+        inputs: Iterable[Any],
+        *,
+        input_format: Optional[InputFormatLike] = None,
+        output_format: Optional[OutputFormatLike] = None,
+    ) -> Iterator[Tuple[Any, ...]]:
+        ...
+
+    @overload
+    def compile_many(
+        self,
+        inputs: Iterable[Any],
+        *,
+        input_format: Optional[InputFormatLike] = None,
+        output_format: Optional[OutputFormatLike] = None,
+        callback: Callable[[Any, Tuple[Any, ...]], None],
+    ) -> None:
+        ...
+
+    def compile_many(
+        self,
+        inputs,
+        *,
+        input_format=None,
+        output_format=None,
+        callback=None,
+    ):
+        """Runs the compiler on multiple inputs, one after the other.
+
+        This method is meant for compiling a large number of (typically small)
+        programs from Python. The optimiser of the compiler, the execution
+        context of ``.led`` source files and the visitor dispatch tables are
+        kept between inputs, and no progress bar is constructed for the
+        individual inputs, so the per-input overhead is kept to a minimum.
+
+        Parameters:
+            inputs: the inputs to compile. Each item may be anything that is
+                accepted by ``compile()``.
+            input_format: the input format of *all* the inputs or ``None`` if
+                it should be inferred from the extensions of the input files
+            output_format: the preferred output format of all the inputs.
+                ``None`` means that the compiler returns abstract syntax trees.
+            callback: optional function to call with each input and the
+                corresponding result as soon as the input has been compiled
+
+        Returns:
+            when no callback is given, an iterator that compiles the inputs
+            lazily and yields a tuple containing the output objects of the
+            compiler for each input (just like ``compile()`` would do).
+            When a callback is given, the inputs are compiled immediately,
+            the results are forwarded to the callback and the method returns
+            ``None``.
+
+        Raises:
+            CompilerError: in case of a compilation error
+        """
+        results = self._iter_compile_many(inputs, input_format, output_format)
+        if callback is None:
+            return (result for _, result in results)
+
+        for input, result in results:
+            callback(input, result)
+
+    @overload
+    def compile_json_stream(
+        self,
+        input: Union[str, Path, IO[str], IO[bytes]],
+        *,
+        output_format: Optional[OutputFormatLike] = None,
+    ) -> Iterator[Tuple[Any, ...]]:
+        ...
+
+    @overload
+    def compile_json_stream(
+        self,
+        input: Union[str, Path, IO[str], IO[bytes]],
+        *,
+        output_format: Optional[OutputFormatLike] = None,
+        callback: Callable[[bytes, Tuple[Any, ...]], None],
+    ) -> None:
+        ...
+
+    def compile_json_stream(self, input, *, output_format=None, callback=None):
+        """Runs the compiler on each light program of a JSON document that
+        contains multiple light programs in JSON format.
+
+        The document is parsed incrementally and each light program is handed
+        to the compiler as soon as it has been read, so only a single light
+        program is kept in memory at any time. The document may contain a
+        single JSON array of light programs or a sequence of light programs
+        separated by whitespace (e.g., one program per line). See
+        ``compile_many()`` for more details about how the light programs are
+        compiled.
+
+        Parameters:
+            input: the name of the file that contains the document, or a
+                stream (in text or binary mode) to read the document from
+            output_format: the preferred output format of all the programs.
+                ``None`` means that the compiler returns abstract syntax trees.
+            callback: optional function to call with the bytecode of each
+                light program and the corresponding result as soon as the
+                program has been compiled
+
+        Returns:
+            when no callback is given, an iterator that reads and compiles the
+            light programs lazily and yields a tuple containing the output
+            objects of the compiler for each light program. When a callback is
+            given, the light programs are compiled immediately and the method
+            returns ``None``.
+
+        Raises:
+            CompilerError: in case of a compilation error or when the document
+                is not a valid JSON document containing light programs
+        """
+        return self.compile_many(
+            _iter_json_stream_programs(input),
+            input_format=InputFormat.LEDCTRL_BINARY,
+            output_format=output_format,
+            callback=callback,
+        )
+
+    def _iter_compile_many(
+        self,
+        inputs: Iterable[Any],
+        input_format: Optional[InputFormatLike],
+        output_format: Optional[OutputFormatLike],
+    ) -> Iterator[Tuple[Any, Tuple[Any, ...]]]:
+        """Compiles the given inputs lazily and yields pairs consisting of the
+        input and the result of the compilation.
+        """
+        output_format = OutputFormat(
+            OutputFormat.AST if output_format is None else output_format
+        )
+        for input in inputs:
+            data, format, description = self._prepare_input(input, input_format)
+            try:
+                self.output = self._execute_plan(
+                    data, format, output_format, description=description
+                )
+            finally:
+                if data is not input:
+                    _release_input_data(data)
+            yield input, self.output
+
+    @property
+    def color_quantisation_report(self) -> Optional[ColorQuantisationReport]:
+        """Summary of the changes that the color quantisation made to the
+        program during the last compilation; ``None`` if color quantisation
+        is disabled.
+        """
+        return self._color_quantiser.report if self._color_quantiser else None
+
+    @property
+    def color_tolerance(self) -> int:
+        """Maximum difference allowed between the original and the optimised
+        value of a color channel; zero if colors must not be changed by the
+        optimiser.
+        """
+        return self._color_tolerance
+
+    @color_tolerance.setter
+    def color_tolerance(self, value: int):
+        value = max(0, int(value))
+        if value != self._color_tolerance:
+            self._color_tolerance = value
+            self._optimiser = None
+
     @property
     def optimisation_level(self) -> int:
         """The optimisation level that the compiler will use.
@@ -183,7 +396,138 @@ class BytecodeCompiler:
 
     @optimisation_level.setter
     def optimisation_level(self, value: int):
-        self._optimisation_level = max(0, int(value))
+        value = max(0, int(value))
+        if value != self._optimisation_level:
+            self._optimisation_level = value
+            self._optimiser = None
+
+    @property
+    def timing_tolerance(self) -> int:
+        """Maximum number of frames by which the durations of the commands in
+        different iterations of a loop may differ when the optimiser detects
+        loops; zero if the iterations must be exactly identical.
+        """
+        return self._timing_tolerance
+
+    @timing_tolerance.setter
+    def timing_tolerance(self, value: int):
+        value = max(0, int(value))
+        if value != self._timing_tolerance:
+            self._timing_tolerance = value
+            self._optimiser = None
+
+    def _get_optimiser(self) -> ASTOptimiser:
+        """Returns the AST optimiser corresponding to the current optimisation
+        level. The optimiser is constructed lazily and then reused for
+        subsequent compilations.
+        """
+        if self._optimiser is None:
+            chunked = self.chunked and (
+                self.optimisation_level > 0 or self.color_tolerance > 0
+            )
+            optimiser = create_optimiser_for_level(
+                self.optimisation_level,
+                timing_tolerance=self.timing_tolerance,
+                absolute_time=not chunked,
+            )
+            if self.color_tolerance > 0:
+                self._color_quantiser = ColorQuantiser(self.color_tolerance)
+            else:
+                self._color_quantiser = None
+
+            if chunked:
+                # Passes that need to see the entire program are run before
+                # the program is split into chunks
+                whole_program_optimiser = create_absolute_time_optimiser_for_level(
+                    self.optimisation_level
+                )
+                if self._color_quantiser:
+                    whole_program_optimiser = ChainedASTOptimiser(
+                        [self._color_quantiser, whole_program_optimiser]
+                    )
+                optimiser = ChunkedASTOptimiser(
+                    optimiser, whole_program_optimiser=whole_program_optimiser
+                )
+            elif self._color_quantiser:
+                optimiser = ChainedASTOptimiser([self._color_quantiser, optimiser])
+
+            self._optimiser = optimiser
+        return self._optimiser
+
+    def _execute_plan(
+        self,
+        input_data: bytes,
+        input_format: InputFormat,
+        output_format: OutputFormat,
+        *,
+        description: str,
+        progress: bool = False,
+    ) -> Tuple[Any, ...]:
+        """Constructs and executes the compilation plan that turns the given
+        input data into the given output format.
+
+        Returns:
+            the outputs of the compilation plan
+        """
+        if self._color_quantiser:
+            self._color_quantiser.reset_report()
+
+        plan = Plan()
+        self._collect_stages(plan, input_data, input_format, output_format)
+        return plan.execute(
+            self.environment,
+            force=True,
+            progress=progress,
+            description=description,
+            verbose=self.verbose,
+        )
+
+    def _prepare_input(
+        self, input: Any, input_format: Optional[InputFormatLike]
+    ) -> Tuple[bytes, InputFormat, str]:
+        """Prepares an input object of the compiler for the compilation.
+
+        Parameters:
+            input: the input object; see ``compile()`` for the list of
+                supported types
+            input_format: the preferred input format or ``None`` if it should
+                be inferred from the extension of the input file
+
+        Returns:
+            the raw input data, its format and a short description of the
+            input to show next to the progress bar
+
+        Raises:
+            CompilerError: if the input format cannot be determined
+        """
+        if isinstance(input, Path):
+            input = str(input)
+
+        if isinstance(input, str):
+            if input_format is None:
+                input_format = InputFormat.detect_from_filename(input)
+
+            description = os.path.basename(input)
+            with open(input, "rb") as fp:
+                input = _map_file(fp) if self.map_files else fp.read()
+
+        elif isinstance(input, BUFFER_TYPES):
+            description = "<<raw bytes>>"
+
+        elif isinstance(input, dict):
+            from json import dumps
+
+            description = "<<JSON>>"
+            input = dumps(input).encode("utf-8")
+            input_format = InputFormat.LEDCTRL_JSON
+
+        else:
+            description = "<<unknown>>"
+
+        if input_format is None:
+            raise CompilerError("input format must be specified")
+
+        return input, InputFormat(input_format), description
 
     def _collect_stages(
         self,
@@ -222,8 +566,7 @@ class BytecodeCompiler:
         # Create a function that adds an optimization stage for the AST stage
         # given as an input
         def create_optimisation_stage(ast_stage):
-            optimiser = create_optimiser_for_level(self.optimisation_level)
-            return ASTOptimisationStage(ast_stage, optimiser)
+            return ASTOptimisationStage(ast_stage, self._get_optimiser())
 
         # Determine which factory to use for the output stages
         create_output_stage = self._output_format_to_output_stage_factory.get(
@@ -247,6 +590,8 @@ class BytecodeCompiler:
         if not outputs:
             return
 
+        output_file = os.fspath(output_file)
+
         if len(outputs) > 1 and "{}" not in output_file:
             raise CompilerError(
                 "output filename needs to include a {} placeholder if the "
@@ -258,8 +603,44 @@ class BytecodeCompiler:
 
         for index, output in enumerate(outputs):
             id = id_format.format(index)
-            with open(output_file.format(id), "wb") as fp:
-                fp.write(output)
+            write_file_atomically(output_file.format(id), output)
+
+
+def _map_file(fp: IO[bytes]) -> Union[bytes, mmap]:
+    """Maps the given file into memory for reading. Returns the contents of
+    the file instead if the file cannot be mapped (e.g., because it is
+    empty).
+    """
+    try:
+        return mmap(fp.fileno(), 0, access=ACCESS_READ)
+    except (OSError, ValueError):
+        return fp.read()
+
+
+def _release_input_data(data: Any) -> None:
+    """Releases the input data that the compiler has prepared for a
+    compilation, closing files that were mapped into memory.
+    """
+    if isinstance(data, mmap):
+        try:
+            data.close()
+        except BufferError:
+            # Some views of the mapped file are still alive; the file will be
+            # unmapped when they are garbage-collected
+            pass
+
+
+def _iter_json_stream_programs(
+    input: Union[str, Path, IO[str], IO[bytes]]
+) -> Iterator[bytes]:
+    """Yields the bytecode of the light programs found in a JSON document
+    that is read incrementally from a file or a stream.
+    """
+    if isinstance(input, (str, Path)):
+        with open(input, "rb") as fp:
+            yield from iter_json_programs(fp)
+    else:
+        yield from iter_json_programs(input)
 
 
 def compile(
@@ -281,8 +662,9 @@ def compile(
     Parameters:
         input: the input to compile. When it is a string, it is assumed to
             be the name of a file that contains the input. When it is a
-            bytes object, it is assumed to contain the raw data to compile;
-            in this case, the ``input_format`` parameter must be specified.
+            bytes-like object (bytes, bytearray, memoryview or mmap), it is
+            assumed to contain the raw data to compile; in this case, the
+            ``input_format`` parameter must be specified.
             When it is a dictionary, it is assumed to be the Python
             representation of a JSON object and the ``input_format`` will
             be assumed to be ``InputFormat.LEDCTRL_JSON``.
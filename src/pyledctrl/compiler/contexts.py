@@ -8,7 +8,7 @@ user can use in a LED control file.
 
 from contextlib import contextmanager
 from functools import wraps
-from typing import Any, Dict, List, Type
+from typing import Any, Dict, List, Optional, Type
 
 from pyledctrl.utils import ensure_tuple
 
@@ -51,9 +51,12 @@ class ExecutionContext:
 
     _ast: StatementSequence
     _ast_stack: List[StatementSequence]
+    _globals: Optional[Dict[str, Any]]
+    _has_markers: bool
 
     def __init__(self):
         """Constuctor."""
+        self._globals = None
         self.reset()
 
     @property
@@ -76,7 +79,10 @@ class ExecutionContext:
             add_end_command: whether to add a terminating ``END`` command
                 automatically to the end of the bytecode
         """
-        global_vars = self.get_globals()
+        # Evaluate the code in a shallow copy of the globals so anything that
+        # the code defines or overwrites does not leak into the next
+        # evaluation when the context is reused
+        global_vars = dict(self.get_globals())
         exec(code, global_vars, {})
         if add_end_command:
             last_command = self._ast
@@ -99,11 +105,16 @@ class ExecutionContext:
         return self._globals
 
     def reset(self) -> None:
-        """Resets the execution context to a pristine state."""
+        """Resets the execution context to a pristine state.
+
+        The dictionary of global variables is kept; the functions in it look
+        up the state of the context at call time so they remain valid after a
+        reset.
+        """
         self._ast = StatementSequence()
         self._ast_stack = [self._ast]
         self._labels = {}
-        self._globals = None
+        self._has_markers = False
 
     def _construct_globals(self) -> Dict[str, Any]:
         wrapper_for = self._create_bytecode_func_wrapper
@@ -126,6 +137,7 @@ class ExecutionContext:
             "set_gray": wrapper_for(bytecode.set_gray),
             "set_white": wrapper_for(bytecode.set_white),
             "sleep": wrapper_for(bytecode.sleep),
+            "wait_until": wrapper_for(bytecode.wait_until),
         }
         aliases = dict(off="set_black", on="set_white", goto="jump")
         for alias, func in aliases.items():
@@ -153,6 +165,8 @@ class ExecutionContext:
                     "unknown value returned from bytecode "
                     "function: {0!r}".format(node)
                 )
+            if isinstance(node, Marker):
+                self._has_markers = True
             if isinstance(node, LabelMarker):
                 if node.name in self._labels:
                     raise DuplicateLabelError(node.name)
@@ -166,6 +180,10 @@ class ExecutionContext:
         collected in ``self._ast`` at the end of an execution, finalizes
         jump addresses etc.
         """
+        if not self._has_markers:
+            # Nothing to resolve so there is no need to traverse the tree
+            return
+
         collector = JumpMarkerCollector()
         collector.visit(self._ast)
 
@@ -0,0 +1,78 @@
+"""Exact byte-cost model of the bytecode that the optimisers use to evaluate
+candidate transformations of the abstract syntax tree.
+
+The functions in this module compute the encoded size of hypothetical
+constructs from plain numbers, without constructing the nodes of the
+abstract syntax tree. Each function must return exactly the same number as
+the ``length_in_bytes`` property of the corresponding node would.
+"""
+
+from typing import TYPE_CHECKING, Optional, Sequence
+
+from pyledctrl.varuint import varuint_length
+
+if TYPE_CHECKING:
+    from .ast import Node
+
+__all__ = (
+    "COMMAND_CODE_LENGTH",
+    "LOOP_OVERHEAD",
+    "duration_command_cost",
+    "loop_cost",
+    "statements_cost",
+    "varuint_length",
+)
+
+
+COMMAND_CODE_LENGTH = 1
+"""Number of bytes taken by the code of a command."""
+
+LOOP_OVERHEAD = 3
+"""Number of bytes that a loop adds to the length of its body when it has
+to be encoded with ``LOOP_BEGIN`` and ``LOOP_END`` commands; one byte for
+each of the two commands and one for the iteration count.
+"""
+
+
+def duration_command_cost(frames: int, num_arg_bytes: int = 0) -> int:
+    """Returns the number of bytes needed to encode a command with a
+    duration, such as ``sleep()``, ``wait_until()`` or any of the color
+    commands.
+
+    Parameters:
+        frames: the duration (or timestamp) of the command, in frames
+        num_arg_bytes: the number of bytes taken by the other arguments of
+            the command, e.g., 3 for ``set_color()`` and 1 for
+            ``set_gray()``
+    """
+    return COMMAND_CODE_LENGTH + num_arg_bytes + varuint_length(frames)
+
+
+def loop_cost(iterations: int, body_cost: int) -> int:
+    """Returns the number of bytes needed to encode a loop with the given
+    number of iterations, given the number of bytes needed to encode its
+    body.
+
+    Loops with a single iteration are encoded by their body only. Zero
+    iterations mean an infinite loop. Note that loops without any statements
+    in their bodies are not encoded at all; this function does not handle
+    that case.
+    """
+    if iterations == 1:
+        return body_cost
+    else:
+        return body_cost + LOOP_OVERHEAD
+
+
+def statements_cost(
+    statements: Sequence["Node"], start: int = 0, end: Optional[int] = None
+) -> int:
+    """Returns the number of bytes needed to encode a slice of the given
+    sequence of statements, without copying the slice.
+    """
+    if end is None:
+        end = len(statements)
+    total = 0
+    for index in range(start, end):
+        total += statements[index].length_in_bytes
+    return total
@@ -0,0 +1,192 @@
+"""Incremental reader for JSON documents that contain a large number of
+compiled light programs.
+
+Light programs in JSON format are objects of the form
+``{"version": 1, "data": "<base64-encoded bytecode>"}``. Show exports may
+contain thousands of such programs, either as the items of a top-level JSON
+array or as a sequence of JSON values separated by whitespace (e.g., one
+program per line). The functions in this module read such documents in
+chunks and yield the programs one by one, so only a single program needs to
+be kept in memory at any time.
+"""
+
+from binascii import Error as BinasciiError, a2b_base64
+from codecs import getincrementaldecoder
+from json import JSONDecodeError, JSONDecoder
+from typing import IO, Any, Callable, Iterator, Union
+
+from .errors import CompilerError
+
+__all__ = ("decode_json_program", "iter_json_programs", "iter_json_values")
+
+
+DEFAULT_CHUNK_SIZE = 65536
+"""Default number of bytes or characters to read from the input at once."""
+
+_WHITESPACE = " \t\n\r"
+
+
+def decode_json_program(obj: Any) -> bytes:
+    """Returns the bytecode of a light program in JSON format.
+
+    Parameters:
+        obj: the Python representation of the JSON object of the program
+
+    Raises:
+        CompilerError: if the object is not a valid light program in JSON
+            format
+    """
+    if not isinstance(obj, dict):
+        raise CompilerError("input must be a JSON object")
+
+    if obj.get("version") != 1:
+        raise CompilerError("only version 1 is supported")
+
+    data = obj.get("data", "")
+    if not isinstance(data, str):
+        raise CompilerError("bytecode must be a base64-encoded string")
+
+    # a2b_base64() accepts ASCII strings directly so we do not need to
+    # encode the string into bytes first
+    try:
+        return a2b_base64(data)
+    except (BinasciiError, ValueError):
+        raise CompilerError("invalid base64-encoded bytecode") from None
+
+
+def iter_json_values(
+    fp: Union[IO[str], IO[bytes]], chunk_size: int = DEFAULT_CHUNK_SIZE
+) -> Iterator[Any]:
+    """Reads JSON values incrementally from the given stream and yields them
+    one by one.
+
+    The stream may contain a single top-level JSON array, in which case the
+    items of the array are yielded, or any number of JSON values separated by
+    whitespace (such as newline-delimited JSON). Only the value being parsed
+    and a chunk of the input are kept in memory.
+
+    Parameters:
+        fp: the stream to read from; binary streams are decoded as UTF-8
+        chunk_size: the number of bytes or characters to read at once
+
+    Raises:
+        CompilerError: if the stream does not contain valid JSON
+    """
+    read = _create_text_reader(fp)
+    decoder = JSONDecoder()
+    raw_decode = decoder.raw_decode
+
+    buffer, pos, eof = "", 0, False
+
+    # None until we know whether the input is a single array; in arrays,
+    # 'expected' is "first" after the opening bracket, "value" after a comma
+    # and "separator" after an item
+    in_array = None
+    expected = "first"
+    array_ended = False
+
+    while True:
+        length = len(buffer)
+        while pos < length and buffer[pos] in _WHITESPACE:
+            pos += 1
+
+        if pos >= length:
+            if eof:
+                break
+            chunk = read(chunk_size)
+            buffer, pos = chunk, 0
+            eof = not chunk
+            continue
+
+        char = buffer[pos]
+        if array_ended:
+            raise CompilerError("unexpected data after the end of the JSON array")
+
+        if in_array is None:
+            in_array = char == "["
+            if in_array:
+                pos += 1
+                continue
+
+        if in_array:
+            if char == "]":
+                if expected == "value":
+                    raise CompilerError("trailing comma in JSON array")
+                array_ended = True
+                pos += 1
+                continue
+            elif char == ",":
+                if expected != "separator":
+                    raise CompilerError("unexpected comma in JSON array")
+                expected = "value"
+                pos += 1
+                continue
+            elif expected == "separator":
+                raise CompilerError("missing comma between JSON array items")
+
+        try:
+            value, end = raw_decode(buffer, pos)
+        except JSONDecodeError as ex:
+            if eof:
+                raise CompilerError("invalid JSON input: {0}".format(ex)) from None
+            end = -1
+
+        if end < 0 or (end >= len(buffer) and not eof):
+            # The value may be incomplete; read more data and try again. The
+            # amount of data read grows with the size of the value so values
+            # larger than the chunk size are parsed in linear time
+            chunk = read(max(chunk_size, len(buffer) - pos))
+            buffer, pos = buffer[pos:] + chunk, 0
+            eof = not chunk
+            continue
+
+        pos = end
+        expected = "separator"
+        yield value
+
+        # Drop the consumed part of the buffer if it is large
+        if pos > chunk_size:
+            buffer, pos = buffer[pos:], 0
+
+    if in_array and not array_ended:
+        raise CompilerError("unexpected end of input in JSON array")
+
+
+def iter_json_programs(
+    fp: Union[IO[str], IO[bytes]], chunk_size: int = DEFAULT_CHUNK_SIZE
+) -> Iterator[bytes]:
+    """Reads light programs in JSON format incrementally from the given
+    stream and yields their bytecode one by one.
+
+    See ``iter_json_values()`` for the supported layouts of the stream.
+
+    Parameters:
+        fp: the stream to read from; binary streams are decoded as UTF-8
+        chunk_size: the number of bytes or characters to read at once
+
+    Raises:
+        CompilerError: if the stream does not contain valid JSON or one of the
+            values in the stream is not a light program in JSON format
+    """
+    for value in iter_json_values(fp, chunk_size):
+        yield decode_json_program(value)
+
+
+def _create_text_reader(fp: Union[IO[str], IO[bytes]]) -> Callable[[int], str]:
+    """Returns a function that reads text from the given stream, decoding
+    bytes as UTF-8 if needed.
+    """
+    probe = fp.read(0)
+    if isinstance(probe, str):
+        return fp.read  # type: ignore
+
+    decode = getincrementaldecoder("utf-8")().decode
+
+    def read(size: int) -> str:
+        while True:
+            data = fp.read(size)
+            text = decode(data, final=not data)  # type: ignore
+            if text or not data:
+                return text
+
+    return read
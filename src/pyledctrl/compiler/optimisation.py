@@ -1,11 +1,23 @@
 """AST optimization routines for the ledctrl compiler."""
 
 from abc import ABC, abstractmethod
-from operator import attrgetter
-from typing import Any, List, Optional, Tuple
+from itertools import islice
+from typing import (
+    Any,
+    ClassVar,
+    Dict,
+    Iterable,
+    List,
+    NamedTuple,
+    Optional,
+    Set,
+    Tuple,
+    Type,
+)
 
 from .ast import (
     Command,
+    Comment,
     Duration,
     Node,
     NodeTransformer,
@@ -18,10 +30,21 @@ from .ast import (
     FadeToWhiteCommand,
     FadeToColorCommand,
     SleepCommand,
+    WaitUntilCommand,
+    EndCommand,
+    NopCommand,
+    SetPyroCommand,
+    SetPyroAllCommand,
     LoopBlock,
+    RGBColor,
     Statement,
     StatementSequence,
 )
+from .cost import (
+    duration_command_cost,
+    loop_cost,
+    statements_cost,
+)
 from .utils import TimestampWrapper
 
 
@@ -61,6 +84,34 @@ class ASTOptimiser(ABC):
             raise TypeError(f"optimisation not supported for {obj!r}")
 
 
+class TransformerBasedASTOptimiser(ASTOptimiser):
+    """Base class for AST optimisers that perform their job with a single
+    NodeTransformer_ subclass, declared in the ``Transformer`` class
+    attribute.
+
+    The transformer is constructed lazily and then kept for subsequent
+    invocations so its visitor dispatch table does not have to be rebuilt
+    for every AST that the optimiser processes.
+    """
+
+    Transformer: ClassVar[Type[NodeTransformer]]
+
+    _transformer: Optional[NodeTransformer] = None
+
+    def optimise_ast(self, ast: Node) -> bool:
+        transformer = self._transformer
+        if transformer is None:
+            transformer = self._transformer = self._create_transformer()
+        transformer.visit(ast)
+        return transformer.changed
+
+    def _create_transformer(self) -> NodeTransformer:
+        """Creates the transformer that the optimiser uses. Override this
+        method in subclasses if the transformer needs constructor arguments.
+        """
+        return self.Transformer()
+
+
 class NullASTOptimiser(ASTOptimiser):
     """Null optimiser that does not transform the AST at all."""
 
@@ -97,7 +148,248 @@ class CompositeASTOptimiser(ASTOptimiser):
         return modified_at_least_once
 
 
-class ColorCommandShortener(ASTOptimiser):
+class ChainedASTOptimiser(ASTOptimiser):
+    """AST optimiser that runs multiple "child optimisers" exactly once, in
+    the order they were specified.
+
+    This is useful for optimisers that should run only once before or after
+    other optimisers that are iterated until they reach a fixpoint.
+    """
+
+    _optimisers: List[ASTOptimiser]
+
+    def __init__(self, optimisers: Iterable[ASTOptimiser] = ()):
+        """Constructor.
+
+        Parameters:
+            optimisers: the optimisers to run, in the order they should be
+                executed
+        """
+        self._optimisers = list(optimisers)
+
+    def optimise_ast(self, ast: Node) -> bool:
+        changed = False
+        for optimiser in self._optimisers:
+            changed = optimiser.optimise(ast) or changed
+        return changed
+
+
+class ColorQuantisationReport(NamedTuple):
+    """Summary of the changes made by a ColorQuantiser_."""
+
+    num_colors: int = 0
+    """Number of distinct colors in the input of the quantiser."""
+
+    num_representatives: int = 0
+    """Number of distinct colors after the quantisation."""
+
+    num_commands_changed: int = 0
+    """Number of commands whose color was changed."""
+
+    max_error: int = 0
+    """Maximum difference between the original and the new value of any
+    color channel.
+    """
+
+    def merge(self, other: "ColorQuantisationReport") -> "ColorQuantisationReport":
+        """Merges this report with another one, assuming that the two reports
+        belong to disjoint parts of the same program.
+        """
+        return ColorQuantisationReport(
+            self.num_colors + other.num_colors,
+            self.num_representatives + other.num_representatives,
+            self.num_commands_changed + other.num_commands_changed,
+            max(self.max_error, other.max_error),
+        )
+
+
+_Color = Tuple[int, int, int]
+
+_BLACK: _Color = (0, 0, 0)
+_WHITE: _Color = (255, 255, 255)
+
+
+class ColorQuantiser(ASTOptimiser):
+    """Lossy AST optimiser that replaces colors that are nearly identical to
+    each other with a shared representative color.
+
+    Programs sampled from animation software are often full of colors that
+    differ only by one or two units in some of the color channels. These
+    colors prevent other optimisers from merging consecutive commands or
+    detecting loops as they require exact equality. This optimiser clusters
+    the colors of the program such that each color is replaced by a
+    representative that differs from it by at most ``tolerance`` units in
+    each channel.
+
+    Colors are processed in decreasing order of frequency so the most common
+    colors become the representatives; pure black and white are always kept
+    intact if they appear in the program. Each color is assigned to the
+    closest existing representative within the tolerance or becomes a new
+    representative if there is none. Since representatives are farther from
+    each other than the tolerance, running the optimiser again on its own
+    output does not change anything.
+
+    Color commands whose colors are changed are replaced with ``set_color()``
+    or ``fade_to_color()`` commands; the ColorCommandShortener_ optimiser can
+    then turn them into shorter variants where possible.
+    """
+
+    tolerance: int
+    """Maximum difference allowed between the original and the new value of
+    a color channel.
+    """
+
+    report: ColorQuantisationReport
+    """Summary of the changes made by the optimiser since the last call to
+    ``reset_report()``.
+    """
+
+    def __init__(self, tolerance: int = 2):
+        """Constructor.
+
+        Parameters:
+            tolerance: maximum difference allowed between the original and the
+                new value of a color channel
+        """
+        self.tolerance = max(0, int(tolerance))
+        self.reset_report()
+
+    def optimise_ast(self, ast: Node) -> bool:
+        if self.tolerance <= 0:
+            return False
+
+        commands = list(self._iter_color_commands(ast))
+        if not commands:
+            return False
+
+        counts: Dict[_Color, int] = {}
+        for _, _, color in commands:
+            counts[color] = counts.get(color, 0) + 1
+
+        mapping = self._cluster(counts)
+
+        num_changed, max_error = 0, 0
+        for statements, index, color in commands:
+            new_color = mapping[color]
+            if new_color == color:
+                continue
+
+            error = max(abs(x - y) for x, y in zip(color, new_color))
+            max_error = max(max_error, error)
+            num_changed += 1
+
+            command = statements[index]
+            replacement_factory = (
+                FadeToColorCommand
+                if isinstance(command, self._fade_commands)
+                else SetColorCommand
+            )
+            statements[index] = replacement_factory(
+                color=RGBColor.cached(*new_color), duration=command.duration
+            )
+
+        self.report = self.report.merge(
+            ColorQuantisationReport(
+                len(counts), len(set(mapping.values())), num_changed, max_error
+            )
+        )
+
+        return num_changed > 0
+
+    def reset_report(self) -> None:
+        """Resets the summary of the changes made by the optimiser."""
+        self.report = ColorQuantisationReport()
+
+    _fade_commands = (
+        FadeToColorCommand,
+        FadeToGrayCommand,
+        FadeToBlackCommand,
+        FadeToWhiteCommand,
+    )
+
+    def _cluster(self, counts: Dict[_Color, int]) -> Dict[_Color, _Color]:
+        """Clusters the given colors and returns a mapping from each color to
+        its representative.
+        """
+        tolerance = self.tolerance
+        cell_size = tolerance + 1
+
+        # Representatives are stored in a grid with a cell size such that
+        # all the representatives within the tolerance of a color are in the
+        # same or a neighbouring cell of the color
+        grid: Dict[_Color, List[_Color]] = {}
+        neighbours = [
+            (dr, dg, db) for dr in (-1, 0, 1) for dg in (-1, 0, 1) for db in (-1, 0, 1)
+        ]
+
+        def sort_key(item: Tuple[_Color, int]):
+            color, count = item
+            return color != _BLACK and color != _WHITE, -count, color
+
+        mapping: Dict[_Color, _Color] = {}
+        for color, _ in sorted(counts.items(), key=sort_key):
+            red, green, blue = color
+            cell = (red // cell_size, green // cell_size, blue // cell_size)
+
+            best, best_error = color, cell_size
+            for dr, dg, db in neighbours:
+                candidates = grid.get((cell[0] + dr, cell[1] + dg, cell[2] + db))
+                if not candidates:
+                    continue
+                for candidate in candidates:
+                    error = max(
+                        abs(red - candidate[0]),
+                        abs(green - candidate[1]),
+                        abs(blue - candidate[2]),
+                    )
+                    if error < best_error:
+                        best, best_error = candidate, error
+
+            if best is color:
+                grid.setdefault(cell, []).append(color)
+
+            mapping[color] = best
+
+        return mapping
+
+    @staticmethod
+    def _iter_color_commands(
+        ast: Node,
+    ) -> Iterable[Tuple[List[Node], int, _Color]]:
+        """Iterates over the color commands in the given AST, including the
+        ones nested in loops.
+
+        Yields:
+            the list of statements containing the command, the index of the
+            command in the list and the color of the command
+        """
+        stack = [ast]
+        while stack:
+            node = stack.pop()
+            if isinstance(node, StatementSequence):
+                statements = node.statements
+                for index, statement in enumerate(statements):
+                    if isinstance(statement, (SetColorCommand, FadeToColorCommand)):
+                        color = statement.color
+                        yield statements, index, (
+                            color.red.value,
+                            color.green.value,
+                            color.blue.value,
+                        )
+                    elif isinstance(statement, (SetGrayCommand, FadeToGrayCommand)):
+                        value = statement.value.value
+                        yield statements, index, (value, value, value)
+                    elif isinstance(statement, (SetBlackCommand, FadeToBlackCommand)):
+                        yield statements, index, _BLACK
+                    elif isinstance(statement, (SetWhiteCommand, FadeToWhiteCommand)):
+                        yield statements, index, _WHITE
+                    elif isinstance(statement, (StatementSequence, LoopBlock)):
+                        stack.append(statement)
+            elif isinstance(node, LoopBlock):
+                stack.append(node.body)
+
+
+class ColorCommandShortener(TransformerBasedASTOptimiser):
     """AST optimiser that replaces some color-related commands with variants
     that take a smaller number of bytes.
 
@@ -163,13 +455,254 @@ class ColorCommandShortener(ASTOptimiser):
             else:
                 return node
 
+
+class DeadCodeEliminator(TransformerBasedASTOptimiser):
+    """AST optimiser that removes statements that have no observable effect
+    on the timeline of the program, i.e. on the colors and the pyro channels
+    as seen by the executor.
+
+    Statements removed by this optimiser are:
+
+        - ``nop()`` commands and ``sleep()`` commands with zero duration
+
+        - ``set_color()``, ``set_gray()``, ``set_black()`` and
+          ``set_white()`` commands with zero duration that are immediately
+          overridden by another such command at the same timestamp
+
+        - ``pyro_enable()`` and ``pyro_disable()`` commands whose channels
+          are all overridden by later pyro commands at the same timestamp,
+          and ``pyro_set_all()`` commands that are overridden by another
+          ``pyro_set_all()`` command at the same timestamp
+
+        - loops and statement sequences that contain no statements other
+          than comments
+
+        - all statements that follow an ``end()`` command, including the ones
+          that follow a loop whose body always ends the program
+
+    Loop bodies and nested statement sequences are processed recursively.
+    Since other optimisers look for patterns in consecutive statements, this
+    optimiser should be executed before them.
+    """
+
+    class Transformer(NodeTransformer):
+        """AST transformer that removes the statements described in the
+        description of DeadCodeEliminator_ from statement sequences.
+        """
+
+        _set_color_commands = (
+            SetColorCommand,
+            SetGrayCommand,
+            SetBlackCommand,
+            SetWhiteCommand,
+        )
+
+        def visit_LoopBlock(self, node: LoopBlock) -> LoopBlock:
+            self._process_statements(node.body.statements)
+            return node
+
+        def visit_StatementSequence(self, node: StatementSequence) -> StatementSequence:
+            self._process_statements(node.statements)
+            return node
+
+        def _process_statements(self, statements: List[Statement]) -> bool:
+            """Removes the dead statements from the given list of statements
+            in-place.
+
+            Returns:
+                whether the execution of the statements always ends the
+                program
+            """
+            result = []
+            ends = False
+            for statement in statements:
+                if isinstance(statement, NopCommand):
+                    continue
+                elif isinstance(statement, SleepCommand):
+                    if statement.duration.value == 0:
+                        continue
+                elif isinstance(statement, EndCommand):
+                    ends = True
+                elif isinstance(statement, StatementSequence):
+                    ends = self._process_statements(statement.statements)
+                    if _contains_only_comments(statement.statements):
+                        continue
+                elif isinstance(statement, LoopBlock):
+                    # Loops are executed at least once; zero iterations
+                    # means an infinite loop
+                    ends = self._process_statements(statement.body.statements)
+                    if _contains_only_comments(statement.body.statements):
+                        continue
+
+                result.append(statement)
+                if ends:
+                    break
+
+            result = self._remove_overridden_commands(result)
+            if len(result) != len(statements):
+                statements[:] = result
+                self.changed = True
+
+            return ends
+
+        def _remove_overridden_commands(
+            self, statements: List[Statement]
+        ) -> List[Statement]:
+            """Returns a copy of the given list of statements without the color
+            and pyro commands that are overridden by other commands at the
+            same timestamp.
+            """
+            result = []
+
+            # Whether the color is set again before the time advances
+            color_overridden = False
+
+            # Pyro channels that are set again before the time advances;
+            # None means all the channels
+            pyro_overridden: Optional[Set[int]] = set()
+
+            for statement in reversed(statements):
+                if isinstance(statement, Comment):
+                    pass
+
+                elif isinstance(statement, self._set_color_commands):
+                    if statement.duration.value == 0:
+                        if color_overridden:
+                            continue
+                    else:
+                        pyro_overridden = set()
+                    color_overridden = True
+
+                elif isinstance(statement, SetPyroCommand):
+                    channels = statement.mask.channels
+                    if pyro_overridden is None or pyro_overridden.issuperset(channels):
+                        continue
+                    pyro_overridden.update(channels)
+
+                elif isinstance(statement, SetPyroAllCommand):
+                    if pyro_overridden is None:
+                        continue
+                    pyro_overridden = None
+
+                else:
+                    color_overridden = False
+                    pyro_overridden = set()
+
+                result.append(statement)
+
+            result.reverse()
+            return result
+
+
+def _contains_only_comments(statements: Iterable[Statement]) -> bool:
+    """Returns whether the given statements contain nothing but comments."""
+    return all(isinstance(statement, Comment) for statement in statements)
+
+
+class SleepEncodingSelector(ASTOptimiser):
+    """AST optimiser that chooses between the relative ``sleep()`` and the
+    absolute ``wait_until()`` encoding of waits, based on the number of bytes
+    that the two encodings need in the bytecode.
+
+    The optimiser tracks the absolute time (in frames) at each top-level
+    statement of the program, including the statements that follow loops
+    with a known, finite duration. It stops tracking the time at the first
+    statement whose duration cannot be determined in advance, e.g., an
+    infinite loop or a loop containing a ``wait_until()`` command. Loop
+    bodies are never modified because they are executed at several
+    different timestamps.
+
+    Since the absolute timestamp of the end of a wait is never smaller than
+    its duration, the relative encoding is never longer than the absolute
+    one. In practice this means that ``wait_until()`` commands at known
+    positions are replaced by ``sleep()`` commands, which can then be merged
+    with other commands or become part of loops. ``wait_until()`` commands
+    whose timestamp is already in the past are replaced by zero-length
+    sleeps, which are removed by the DeadCodeEliminator_.
+    """
+
     def optimise_ast(self, ast: Node) -> bool:
-        transformer = self.Transformer()
-        transformer.visit(ast)
-        return transformer.changed
+        if not isinstance(ast, StatementSequence):
+            return False
+        changed, _ = self._process_statements(ast.statements, 0)
+        return changed
 
+    def _process_statements(
+        self, statements: List[Statement], time: int
+    ) -> Tuple[bool, Optional[int]]:
+        """Processes the given list of top-level statements in-place, assuming
+        that the first statement is executed at the given time.
 
-class CommandMerger(ASTOptimiser):
+        Returns:
+            whether the statements were modified, and the time after the
+            execution of the statements, in frames; ``None`` if it cannot be
+            determined
+        """
+        changed = False
+        for index, statement in enumerate(statements):
+            if isinstance(statement, WaitUntilCommand):
+                timestamp = statement.timestamp.value
+                duration = max(timestamp - time, 0)
+                if duration_command_cost(duration) <= duration_command_cost(timestamp):
+                    statements[index] = SleepCommand(Duration.from_frames(duration))
+                    changed = True
+                time += duration
+            elif isinstance(statement, StatementSequence):
+                nested_changed, end = self._process_statements(
+                    statement.statements, time
+                )
+                changed = changed or nested_changed
+                if end is None:
+                    break
+                time = end
+            else:
+                duration = _get_duration_in_frames(statement)
+                if duration is None:
+                    break
+                time += duration
+
+        else:
+            return changed, time
+
+        return changed, None
+
+
+def _get_duration_in_frames(statement: Statement) -> Optional[int]:
+    """Returns the time needed to execute the given statement, in frames, or
+    ``None`` if it cannot be determined without knowing the absolute time
+    when the statement is executed, or if the statement never terminates.
+    """
+    if isinstance(statement, (Comment, NopCommand, SetPyroCommand, SetPyroAllCommand)):
+        return 0
+
+    elif isinstance(statement, Command):
+        if "duration" in statement._fields:
+            return statement.duration.value  # type: ignore
+        else:
+            return None
+
+    elif isinstance(statement, StatementSequence):
+        total = 0
+        for item in statement.statements:
+            duration = _get_duration_in_frames(item)
+            if duration is None:
+                return None
+            total += duration
+        return total
+
+    elif isinstance(statement, LoopBlock):
+        iterations = statement.iterations.value
+        if iterations <= 0:
+            # Infinite loop
+            return None
+        duration = _get_duration_in_frames(statement.body)
+        return duration * iterations if duration is not None else None
+
+    else:
+        return None
+
+
+class CommandMerger(TransformerBasedASTOptimiser):
     """AST optimiser that merges consecutive commands into one if they
     meet certain conditions.
 
@@ -208,7 +741,7 @@ class CommandMerger(ASTOptimiser):
 
             color = original_command.color
             duration, length = 0, 0
-            for statement in body[index:]:
+            for statement in islice(body, index, None):
                 if isinstance(statement, SetColorCommand) and statement.color.equals(
                     color
                 ):
@@ -239,7 +772,7 @@ class CommandMerger(ASTOptimiser):
 
             color = original_command.color
             duration, length = 0, 1
-            for statement in body[index + 1 :]:
+            for statement in islice(body, index + 1, None):
                 if isinstance(statement, SetColorCommand) and statement.color.equals(
                     color
                 ):
@@ -269,7 +802,7 @@ class CommandMerger(ASTOptimiser):
             assert isinstance(original_command, SleepCommand)
 
             duration, length = 0, 0
-            for statement in body[index:]:
+            for statement in islice(body, index, None):
                 if isinstance(statement, SleepCommand):
                     duration += statement.duration.value
                 else:
@@ -311,17 +844,44 @@ class CommandMerger(ASTOptimiser):
                 else:
                     index += 1
 
-    def optimise_ast(self, ast: Node) -> bool:
-        transformer = self.Transformer()
-        transformer.visit(ast)
-        return transformer.changed
-
 
-class LoopDetector(ASTOptimiser):
+class LoopDetector(TransformerBasedASTOptimiser):
     """AST optimiser that attempts to detect repetitive invocations of the
     same set of commands, and replaces them with a loop of fixed length.
+
+    By default, the iterations of a loop must be exactly identical. When the
+    timing tolerance of the optimiser is positive, commands that differ only
+    in their durations are also considered identical if their durations are
+    within the tolerance (in frames) from the duration of the corresponding
+    command in the first iteration. The body of the loop is then taken from
+    the first iteration, and loops are formed only if the timeline of the
+    loop never deviates from the timeline of the original commands by more
+    than the tolerance at any command boundary. The remaining deviation at
+    the end of the loop is compensated by a ``sleep()`` command after the
+    loop or by shortening the command that follows the loop, so the timeline
+    is back in sync after the loop and deviations of consecutive loops never
+    add up.
+    """
+
+    timing_tolerance: int
+    """Maximum number of frames by which the duration of a command in a
+    loop iteration may differ from the duration of the same command in the
+    first iteration of the loop.
     """
 
+    def __init__(self, timing_tolerance: int = 0):
+        """Constructor.
+
+        Parameters:
+            timing_tolerance: maximum number of frames by which the duration
+                of a command in a loop iteration may differ from the duration
+                of the same command in the first iteration of the loop
+        """
+        self.timing_tolerance = max(0, int(timing_tolerance))
+
+    def _create_transformer(self) -> NodeTransformer:
+        return self.Transformer(timing_tolerance=self.timing_tolerance)
+
     class Transformer(NodeTransformer):
         """AST transformer that analyses ``StatementSequence`` nodes and
         replaces repetitive slices of the statement sequence with loop
@@ -329,10 +889,12 @@ class LoopDetector(ASTOptimiser):
         """
 
         max_loop_len: int
+        timing_tolerance: int
 
-        def __init__(self):
+        def __init__(self, timing_tolerance: int = 0):
             super().__init__()
             self.max_loop_len = 8
+            self.timing_tolerance = timing_tolerance
 
         def _identify_loop_iteration_count(
             self, statements: List[Statement], start_index: int, loop_body_length: int
@@ -353,7 +915,127 @@ class LoopDetector(ASTOptimiser):
             # more than 255 anyway
             return min((second - start_index) // loop_body_length, 255)
 
+        def _identify_tolerant_loop(
+            self, statements: List[Statement], start_index: int, loop_body_length: int
+        ) -> Tuple[int, int]:
+            """Identifies the maximum iteration count of a potential loop
+            that starts at the given index and has the given assumed body
+            length, allowing the durations of the commands to differ from
+            the durations in the first iteration within the timing tolerance.
+
+            Returns:
+                the iteration count and the difference between the duration of
+                the loop and the total duration of the statements that the loop
+                would replace, in frames
+            """
+            tolerance = self.timing_tolerance
+            num_statements = len(statements)
+            end = min(num_statements, start_index + 255 * loop_body_length)
+
+            iterations, drift, drift_at_end = 1, 0, 0
+            reference_index = start_index
+            index = start_index + loop_body_length
+            while index < end:
+                reference = statements[reference_index]
+                statement = statements[index]
+                delta = _get_duration_difference(reference, statement, tolerance)
+                if delta is None:
+                    break
+
+                drift += delta
+                if drift > tolerance or drift < -tolerance:
+                    break
+
+                index += 1
+                reference_index += 1
+                if reference_index == start_index + loop_body_length:
+                    reference_index = start_index
+                    iterations += 1
+                    drift_at_end = drift
+
+            return iterations, drift_at_end
+
+        def _find_tolerant_replacement(
+            self, body: List[Statement], index: int
+        ) -> Optional[Tuple[int, List[Statement]]]:
+            """Finds the best loop that starts at the given index, allowing
+            the durations of the iterations to differ within the timing
+            tolerance.
+
+            Returns:
+                the number of statements to replace, starting from the given
+                index, and the statements to replace them with, or ``None`` if
+                no loop would make the bytecode smaller
+            """
+            statement = body[index]
+            num_statements = len(body)
+            max_end = min(num_statements, index + self.max_loop_len)
+            tolerance = self.timing_tolerance
+
+            # Candidates are evaluated with the cost model; nodes are
+            # constructed only for the best one
+            best: Optional[Tuple[int, int, int]] = None
+            best_saving = 0
+
+            for end in range(index + 1, max_end):
+                if _get_duration_difference(statement, body[end], tolerance) is None:
+                    continue
+
+                body_length = end - index
+                iterations, drift = self._identify_tolerant_loop(
+                    body, index, body_length
+                )
+                if iterations < 2:
+                    continue
+
+                loop_end = index + iterations * body_length
+                new_size = loop_cost(iterations, statements_cost(body, index, end))
+
+                if drift < 0:
+                    # Loop is shorter than the original statements
+                    new_size += duration_command_cost(-drift)
+                elif drift > 0:
+                    # Loop is longer than the original statements; shorten
+                    # the next statement if possible
+                    if loop_end >= num_statements:
+                        continue
+                    next_statement = body[loop_end]
+                    duration = _get_shortenable_duration(next_statement, drift)
+                    if duration is None:
+                        continue
+                    new_size += (
+                        next_statement.length_in_bytes
+                        - duration_command_cost(duration)
+                        + duration_command_cost(duration - drift)
+                    )
+                    loop_end += 1
+
+                saving = statements_cost(body, index, loop_end) - new_size
+                if saving > best_saving:
+                    best, best_saving = (end, iterations, drift), saving
+
+            if best is None:
+                return None
+
+            end, iterations, drift = best
+            loop_end = index + iterations * (end - index)
+            replacement: List[Statement] = [
+                LoopBlock(
+                    iterations=iterations, body=StatementSequence(body[index:end])
+                )
+            ]
+            if drift < 0:
+                replacement.append(SleepCommand(duration=Duration(-drift)))
+            elif drift > 0:
+                replacement.append(_with_shorter_duration(body[loop_end], drift))
+                loop_end += 1
+
+            return loop_end - index, replacement
+
         def visit_StatementSequence(self, node: StatementSequence) -> None:
+            if self.timing_tolerance > 0:
+                return self._visit_statement_sequence_with_tolerance(node)
+
             body = node.statements
             index = 0
             num_statements = len(body)
@@ -387,17 +1069,17 @@ class LoopDetector(ASTOptimiser):
                     # Find the best loop, i.e. the one that takes the smallest
                     # amount of space, and replace the body with the best
                     # loop
-                    blocks = [
-                        LoopBlock(
-                            iterations=iterations_,
-                            body=StatementSequence(body[index:end]),
-                        )
-                        for end, iterations_ in potential_loops
-                    ]
-                    best_block = min(blocks, key=attrgetter("length_in_bytes"))
-                    end = index + best_block.iterations.value * len(
-                        best_block.body.statements
+                    end, iterations = min(
+                        potential_loops,
+                        key=lambda item: loop_cost(
+                            item[1], statements_cost(body, index, item[0])
+                        ),
                     )
+                    best_block = LoopBlock(
+                        iterations=iterations,
+                        body=StatementSequence(body[index:end]),
+                    )
+                    end = index + iterations * (end - index)
                     body[index:end] = [best_block]
                     num_statements = len(body)
                     index += 1
@@ -405,13 +1087,87 @@ class LoopDetector(ASTOptimiser):
                     # Just jump to the next statement
                     index += 1
 
-    def optimise_ast(self, ast: Node) -> bool:
-        transformer = self.Transformer()
-        transformer.visit(ast)
-        return transformer.changed
+        def _visit_statement_sequence_with_tolerance(
+            self, node: StatementSequence
+        ) -> None:
+            body = node.statements
+            index = 0
+            while index < len(body):
+                result = self._find_tolerant_replacement(body, index)
+                if result is not None:
+                    length, replacement = result
+                    body[index : index + length] = replacement
+                    self.changed = True
+                    index += len(replacement)
+                else:
+                    index += 1
+
+
+def _get_duration_difference(
+    reference: Statement, statement: Statement, tolerance: int
+) -> Optional[int]:
+    """Compares two statements, allowing their durations to differ within
+    the given tolerance.
+
+    Returns:
+        the difference between the duration of the reference statement and
+        the other statement in frames, or ``None`` if the two statements are
+        not equivalent within the given tolerance
+    """
+    if reference is statement:
+        return 0
+
+    if reference.__class__ is not statement.__class__:
+        return None
 
+    duration = getattr(reference, "duration", None)
+    if not isinstance(duration, Duration) or not isinstance(reference, Command):
+        return 0 if are_statements_equivalent(reference, statement) else None
 
-def create_optimiser_for_level(level: int = 2) -> ASTOptimiser:
+    delta = duration.value - statement.duration.value  # type: ignore
+    if delta > tolerance or delta < -tolerance:
+        return None
+
+    for field in reference._fields:
+        if field != "duration" and (
+            getattr(reference, field).to_bytecode()
+            != getattr(statement, field).to_bytecode()
+        ):
+            return None
+
+    return delta
+
+
+def _get_shortenable_duration(statement: Statement, frames: int) -> Optional[int]:
+    """Returns the duration of the given statement in frames if it is a
+    command whose duration can be shortened by the given number of frames,
+    ``None`` otherwise.
+    """
+    duration = getattr(statement, "duration", None)
+    if (
+        not isinstance(statement, Command)
+        or not isinstance(duration, Duration)
+        or duration.value < frames
+    ):
+        return None
+    return duration.value
+
+
+def _with_shorter_duration(statement: Statement, frames: int) -> Command:
+    """Returns a copy of the given statement with its duration shortened by
+    the given number of frames. The statement must be a command whose
+    duration can be shortened; see ``_get_shortenable_duration()``.
+    """
+    assert _get_shortenable_duration(statement, frames) is not None
+
+    fields = dict(statement.iter_fields())
+    fields["duration"] = Duration(statement.duration.value - frames)  # type: ignore
+    return statement.__class__(**fields)  # type: ignore
+
+
+def create_optimiser_for_level(
+    level: int = 2, *, timing_tolerance: int = 0, absolute_time: bool = True
+) -> ASTOptimiser:
     """Creates an AST optimiser for the given optimisation level.
 
     Currently we have the following optimisation levels:
@@ -425,6 +1181,17 @@ def create_optimiser_for_level(level: int = 2) -> ASTOptimiser:
 
     Parameters:
         level: the optimisation level
+        timing_tolerance: maximum number of frames by which the durations of
+            the commands in different iterations of a loop may differ from
+            each other when the optimiser detects loops. See LoopDetector_ for
+            more details.
+        absolute_time: whether to include the optimisers that rely on the
+            absolute time when each statement of the AST is executed. These
+            optimisers assume that the AST is the entire program; set this to
+            ``False`` when parts of a program are optimised independently,
+            and run the optimiser returned by
+            ``create_absolute_time_optimiser_for_level()`` on the entire
+            program instead.
 
     Returns:
         the AST optimiser to use for the given optimisation level
@@ -434,8 +1201,30 @@ def create_optimiser_for_level(level: int = 2) -> ASTOptimiser:
 
     result = CompositeASTOptimiser()
     if level >= 1:
+        result.add_optimiser(DeadCodeEliminator())
+        if absolute_time:
+            result.add_optimiser(SleepEncodingSelector())
         result.add_optimiser(CommandMerger())
         result.add_optimiser(ColorCommandShortener())
     if level >= 2:
-        result.add_optimiser(LoopDetector())
+        result.add_optimiser(LoopDetector(timing_tolerance=timing_tolerance))
     return result
+
+
+def create_absolute_time_optimiser_for_level(level: int = 2) -> ASTOptimiser:
+    """Creates an AST optimiser that contains only those optimisers of the
+    given optimisation level that rely on the absolute time when each
+    statement of the AST is executed, and that must therefore be run on the
+    entire program.
+
+    Parameters:
+        level: the optimisation level
+
+    Returns:
+        the AST optimiser to run on the entire program for the given
+        optimisation level
+    """
+    if level <= 0:
+        return NullASTOptimiser()
+    else:
+        return SleepEncodingSelector()
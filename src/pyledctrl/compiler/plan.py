@@ -22,7 +22,8 @@ __all__ = ("Plan",)
 
 class _FakeProgressBar(AbstractContextManager):  # pragma: no cover
     """Fake progress bar class that provides the same interface as `tqdm.tqdm()`
-    to be used in places where `tdqm` does not have to be present.
+    to be used in places where `tdqm` does not have to be present or where the
+    progress bar is disabled anyway.
     """
 
     def __exit__(self, *args, **kwds):
@@ -34,8 +35,8 @@ class _FakeProgressBar(AbstractContextManager):  # pragma: no cover
     def update(self, *args, **kwds):
         pass
 
-    def write(self, *args, **kwds):
-        pass
+    def write(self, s, file=None, end="\n", *args, **kwds):
+        print(s, file=file, end=end)
 
 
 class Plan:
@@ -117,11 +118,16 @@ class Plan:
             "bar_format": bar_format,
             "total": num_steps,
         }
-        try:
-            from tqdm import tqdm
+        if progress:
+            try:
+                from tqdm import tqdm
 
-            progress_bar_factory = partial(tqdm, **tqdm_kwds)
-        except ImportError:  # pragma: no cover
+                progress_bar_factory = partial(tqdm, **tqdm_kwds)
+            except ImportError:  # pragma: no cover
+                progress_bar_factory = _FakeProgressBar
+        else:
+            # No need to construct a disabled tqdm progress bar; this matters
+            # when the compiler is invoked for thousands of small inputs
             progress_bar_factory = _FakeProgressBar
 
         with progress_bar_factory() as progress_bar:
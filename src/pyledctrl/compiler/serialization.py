@@ -0,0 +1,292 @@
+"""Compact binary serialization of abstract syntax trees.
+
+Pickling an abstract syntax tree is slow and the result is bulky because
+every literal node (bytes, durations, colors) is pickled as a separate
+object. The functions in this module serialize an abstract syntax tree into
+a pre-order opcode stream instead, which is suitable for caching ASTs on the
+disk and for passing them between processes.
+
+The stream starts with a header and then contains a single statement. Commands
+are stored as their own bytecode since it is already a compact and lossless
+representation of the command. Nodes that do not have a bytecode of their own
+(or whose bytecode loses information, such as loops with a single iteration
+and comments) use opcodes from the ``0xF0-0xFF`` range that is never used by
+command codes:
+
+- ``0xF0``, iterations (1 byte), statement: loop block
+- ``0xF1``, count (varuint), count * statement: statement sequence
+- ``0xF2``, index (varuint): comment whose text is already in the string table
+- ``0xF3``, length (varuint), UTF-8 text: comment with a new text that is also
+  appended to the string table
+
+The loader rebuilds the nodes straight from the buffer and shares the
+immutable literal nodes (bytes, durations and colors) between the commands.
+"""
+
+from typing import Callable, Dict, List, Tuple, Type
+
+from pyledctrl.varuint import decode_varuint, encode_varuint_into
+
+from .ast import (
+    ChannelMask,
+    ChannelValues,
+    Command,
+    Comment,
+    Duration,
+    LoopBlock,
+    Node,
+    NodeList,
+    RGBColor,
+    StatementSequence,
+    UnsignedByte,
+    Varuint,
+)
+from .errors import BytecodeParserEOFError, BytecodeParserError, InvalidASTFormatError
+
+__all__ = ("dump_ast", "load_ast")
+
+
+_MAGIC = b"LEDAST"
+_VERSION = 1
+_HEADER = _MAGIC + bytes([_VERSION])
+
+_LOOP = 0xF0
+_SEQUENCE = 0xF1
+_COMMENT_REF = 0xF2
+_COMMENT_NEW = 0xF3
+
+
+def dump_ast(node: Node) -> bytes:
+    """Serializes an abstract syntax tree into a compact binary
+    representation.
+
+    Parameters:
+        node: the root of the abstract syntax tree; it must be a statement
+            or a statement sequence
+
+    Returns:
+        the serialized representation of the abstract syntax tree
+
+    Raises:
+        TypeError: if the tree contains a node that cannot be serialized
+    """
+    result = bytearray(_HEADER)
+    _ASTDumper(result).dump(node)
+    return bytes(result)
+
+
+def load_ast(data: bytes) -> Node:
+    """Restores an abstract syntax tree from its serialized representation
+    created by ``dump_ast()``.
+
+    Parameters:
+        data: the serialized representation of the abstract syntax tree
+
+    Returns:
+        the root of the restored abstract syntax tree
+
+    Raises:
+        InvalidASTFormatError: if the data does not start with the expected
+            header
+        BytecodeParserError: if the data is corrupted
+    """
+    data = bytes(data)
+    if not data.startswith(_MAGIC):
+        raise InvalidASTFormatError(None, None)
+    if data[len(_MAGIC) : len(_HEADER)] != _HEADER[len(_MAGIC) :]:
+        raise InvalidASTFormatError(
+            None, None, "Unsupported AST serialization format version"
+        )
+
+    loader = _ASTLoader(data, len(_HEADER))
+    try:
+        node = loader.load_statement()
+    except (EOFError, IndexError):
+        raise BytecodeParserEOFError(None) from None
+
+    if loader.pos != len(data):
+        raise BytecodeParserError("trailing data after serialized AST")
+
+    return node
+
+
+class _ASTDumper:
+    """Helper object that writes the serialized representation of an AST
+    into a byte buffer.
+    """
+
+    def __init__(self, output: bytearray):
+        self._output = output
+        self._strings: Dict[str, int] = {}
+
+    def dump(self, node: Node) -> None:
+        output = self._output
+
+        if isinstance(node, Command):
+            output += node.to_bytecode()
+
+        elif isinstance(node, StatementSequence):
+            output.append(_SEQUENCE)
+            encode_varuint_into(output, len(node.statements))
+            for statement in node.statements:
+                self.dump(statement)
+
+        elif isinstance(node, LoopBlock):
+            output.append(_LOOP)
+            output.append(node.iterations.value)
+            self.dump(node.body)
+
+        elif isinstance(node, Comment):
+            index = self._strings.get(node.value)
+            if index is None:
+                self._strings[node.value] = len(self._strings)
+                encoded = node.value.encode("utf-8")
+                output.append(_COMMENT_NEW)
+                encode_varuint_into(output, len(encoded))
+                output += encoded
+            else:
+                output.append(_COMMENT_REF)
+                encode_varuint_into(output, index)
+
+        else:
+            raise TypeError(
+                "cannot serialize node of type {0}".format(node.__class__.__name__)
+            )
+
+
+_bytes: Tuple[UnsignedByte, ...] = tuple(UnsignedByte(i) for i in range(256))
+"""Shared UnsignedByte_ instances for all possible values."""
+
+
+class _ASTLoader:
+    """Helper object that restores an AST from its serialized representation."""
+
+    pos: int
+    """Index of the next byte to read."""
+
+    def __init__(self, data: bytes, pos: int = 0):
+        self._data = data
+        self._strings: List[str] = []
+        self._readers = _get_command_readers()
+        self.pos = pos
+
+    def load_statement(self) -> Node:
+        data = self._data
+        code = data[self.pos]
+        self.pos += 1
+
+        reader = self._readers.get(code)
+        if reader is not None:
+            return reader(self)
+
+        if code == _SEQUENCE:
+            count = self.read_varuint()
+            load = self.load_statement
+            return StatementSequence(NodeList([load() for _ in range(count)]))
+
+        elif code == _LOOP:
+            iterations = _bytes[data[self.pos]]
+            self.pos += 1
+            body = self.load_statement()
+            if not isinstance(body, StatementSequence):
+                raise BytecodeParserError("loop body must be a statement sequence")
+            return LoopBlock(iterations, body)
+
+        elif code == _COMMENT_REF:
+            index = self.read_varuint()
+            if index >= len(self._strings):
+                raise BytecodeParserError("invalid string index: {0}".format(index))
+            return Comment(self._strings[index])
+
+        elif code == _COMMENT_NEW:
+            length = self.read_varuint()
+            start, end = self.pos, self.pos + length
+            if end > len(data):
+                raise IndexError
+            value = data[start:end].decode("utf-8")
+            self.pos = end
+            self._strings.append(value)
+            return Comment(value)
+
+        else:
+            raise BytecodeParserError("unknown opcode: {0}".format(code))
+
+    def read_byte(self) -> UnsignedByte:
+        value = self._data[self.pos]
+        self.pos += 1
+        return _bytes[value]
+
+    def read_color(self) -> RGBColor:
+        pos = self.pos
+        data = self._data
+        self.pos = pos + 3
+        return RGBColor.cached(data[pos], data[pos + 1], data[pos + 2])
+
+    def read_duration(self) -> Duration:
+        return Duration.from_frames(self.read_varuint())
+
+    def read_varuint(self) -> int:
+        value, self.pos = decode_varuint(self._data, self.pos)
+        return value
+
+
+_FieldReader = Callable[[_ASTLoader], Node]
+
+_field_readers: Dict[Type[Node], _FieldReader] = {
+    UnsignedByte: _ASTLoader.read_byte,
+    Duration: _ASTLoader.read_duration,
+    Varuint: lambda loader: Varuint(loader.read_varuint()),
+    RGBColor: _ASTLoader.read_color,
+    ChannelMask: lambda loader: _read_channel_mask(loader),
+    ChannelValues: lambda loader: _read_channel_values(loader),
+}
+
+
+_command_readers: Dict[int, Callable[[_ASTLoader], Node]] = {}
+
+
+def _bits_of(value: int) -> Tuple[int, ...]:
+    return tuple(index for index in range(7) if value & (1 << index))
+
+
+def _read_channel_mask(loader: _ASTLoader) -> ChannelMask:
+    value = loader.read_byte().value
+    return ChannelMask(enable=bool(value & 0x80), channels=_bits_of(value))
+
+
+def _read_channel_values(loader: _ASTLoader) -> ChannelValues:
+    return ChannelValues(_bits_of(loader.read_byte().value))
+
+
+def _create_command_reader(cls: Type[Command]) -> Callable[[_ASTLoader], Node]:
+    """Creates a function that reads the fields of a command of the given
+    class from a loader and constructs the command.
+    """
+    defaults: Dict[str, Type[Node]] = getattr(cls, "_defaults", None) or {}
+    field_readers = []
+    for field in cls._fields:
+        field_type = defaults.get(field)
+        reader = _field_readers.get(field_type) if field_type else None
+        if reader is None:
+            raise TypeError("cannot deserialize {0}.{1}".format(cls.__name__, field))
+        field_readers.append(reader)
+
+    if not field_readers:
+        return lambda loader: cls()
+    elif len(field_readers) == 1:
+        (read,) = field_readers
+        return lambda loader: cls(read(loader))
+    else:
+        return lambda loader: cls(*[read(loader) for read in field_readers])
+
+
+def _get_command_readers() -> Dict[int, Callable[[_ASTLoader], Node]]:
+    """Returns a dictionary mapping command codes to the functions that read
+    the corresponding commands from a loader.
+    """
+    if not _command_readers:
+        for cls in Command.__subclasses__():
+            code = getattr(cls, "code", None)
+            if code is not None:
+                _command_readers[ord(code)] = _create_command_reader(cls)
+    return _command_readers
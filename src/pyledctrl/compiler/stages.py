@@ -3,6 +3,7 @@
 import os
 
 from abc import ABC, abstractmethod, abstractproperty
+from io import BytesIO, TextIOWrapper
 from typing import Generic, List, Optional, TypeVar, Union
 
 from pyledctrl.compiler.optimisation import ASTOptimiser
@@ -11,6 +12,7 @@ from .ast import Node
 from .contexts import ExecutionContext
 from .errors import CompilerError
 from .utils import get_timestamp_of
+from .writer import LEDSourceWriter
 
 from pyledctrl.logger import log
 from pyledctrl.parsers.bytecode import BytecodeParser
@@ -26,8 +28,24 @@ class CompilationStageExecutionEnvironment:
     compiler itself.
     """
 
+    _execution_context: Optional[ExecutionContext]
+
     def __init__(self):
         """Constructor."""
+        self._execution_context = None
+
+    def get_execution_context(self) -> ExecutionContext:
+        """Returns an execution context in a pristine state that the stages
+        may use to evaluate ``.led`` source code.
+
+        The same context object is recycled between calls so the global
+        variables of the context are constructed only once per environment.
+        """
+        if self._execution_context is None:
+            self._execution_context = ExecutionContext()
+        else:
+            self._execution_context.reset()
+        return self._execution_context
 
     log = log
     warn = log.warn
@@ -310,7 +328,7 @@ class LEDSourceCodeToASTObjectCompilationStage(RawBytesToASTObjectCompilationSta
     def _create_output(
         self, input: bytes, environment: CompilationStageExecutionEnvironment
     ) -> Node:
-        context = ExecutionContext()
+        context = environment.get_execution_context()
         code = compile(input, "<<bytecode>>", "exec")
         context.evaluate(code, add_end_command=True)
         return context.ast
@@ -338,22 +356,20 @@ class JSONBytecodeToASTObjectCompilationStage(RawBytesToASTObjectCompilationStag
         self, input: bytes, environment: CompilationStageExecutionEnvironment
     ) -> Node:
         """Inherited."""
-        from base64 import b64decode
         from json import loads
 
+        from .json_stream import decode_json_program
+
+        if not isinstance(input, (bytes, bytearray)):
+            # json.loads() does not accept memoryviews or mmaps
+            input = bytes(input)
+
         try:
             input = loads(input)
         except Exception:
             raise CompilerError("input must be a JSON object")
 
-        if not isinstance(input, dict):
-            raise CompilerError("input must be a JSON object")
-
-        if input.get("version") != 1:
-            raise CompilerError("only version 1 is supported")
-
-        input = b64decode(input.get("data", "").encode("ascii"))
-        return BytecodeParser().parse(input)
+        return BytecodeParser().parse(decode_json_program(input))
 
 
 class ASTOptimisationStage(ObjectToObjectCompilationStage):
@@ -476,7 +492,14 @@ class ASTObjectToLEDSourceCodeCompilationStage(ASTObjectToRawBytesCompilationSta
         self, input: Node, environment: CompilationStageExecutionEnvironment
     ):
         """Inherited."""
-        output = input.to_led_source().encode("utf-8")
-        if output:
-            output += b"\n"
-        return output
+        # The source code is encoded while it is being written so the output
+        # is never held in memory both as a string and as bytes
+        buffer = BytesIO()
+        stream = TextIOWrapper(buffer, encoding="utf-8", newline="\n")
+        writer = LEDSourceWriter(stream)
+        input.write_led_source(writer)
+        if writer.has_output:
+            writer.write("\n")
+        writer.flush()
+        stream.detach()
+        return buffer.getvalue()
@@ -0,0 +1,103 @@
+"""Streaming writer that is used to convert abstract syntax trees back into
+the ``.led`` source format.
+"""
+
+from contextlib import contextmanager
+from io import StringIO
+from typing import Callable, Iterator, List, Optional, TextIO
+
+__all__ = ("LEDSourceWriter",)
+
+
+class LEDSourceWriter:
+    """Streaming writer for the ``.led`` source format that keeps track of the
+    current indentation level.
+
+    Nodes of the abstract syntax tree write their source code into the writer
+    fragment by fragment. Each newline in a fragment is followed by the
+    indentation of the current block, so nested blocks never need to
+    re-indent the source code of their bodies. This keeps the time needed to
+    produce the source code linear in the length of the output, no matter
+    how deeply the blocks are nested.
+    """
+
+    indent_unit: str
+    """The string to add to the indentation when entering a new block."""
+
+    _indent: str
+    _newline: str
+    _buffer: List[str]
+    _write: Callable[[str], object]
+    _has_output: bool
+
+    _FLUSH_THRESHOLD = 1024
+
+    def __init__(self, fp: Optional[TextIO] = None, indent_unit: str = "    "):
+        """Constructor.
+
+        Parameters:
+            fp: the text stream to write the source code into; ``None`` means
+                to write into an in-memory buffer that can be retrieved with
+                ``getvalue()``
+            indent_unit: the string to add to the indentation when entering
+                a new block
+        """
+        self._fp = fp if fp is not None else StringIO()
+        self._write = self._fp.write
+        self._buffer = []
+        self._has_output = False
+
+        self.indent_unit = indent_unit
+        self._indent = ""
+        self._newline = "\n"
+
+    @property
+    def has_output(self) -> bool:
+        """Returns whether anything (except empty strings) has been written
+        into the writer so far.
+        """
+        return self._has_output
+
+    @contextmanager
+    def indented(self) -> Iterator[None]:
+        """Context manager that increases the indentation level while the
+        execution is in the context.
+        """
+        old_indent = self._indent
+        self._set_indent(old_indent + self.indent_unit)
+        try:
+            yield
+        finally:
+            self._set_indent(old_indent)
+
+    def flush(self) -> None:
+        """Writes the buffered fragments into the underlying stream."""
+        if self._buffer:
+            self._write("".join(self._buffer))
+            self._buffer.clear()
+
+    def getvalue(self) -> str:
+        """Returns the source code written so far when the writer writes into
+        an in-memory buffer.
+        """
+        self.flush()
+        return self._fp.getvalue()  # type: ignore
+
+    def write(self, text: str) -> None:
+        """Writes a fragment of source code, indenting each new line in the
+        fragment according to the current indentation level.
+        """
+        if not text:
+            return
+
+        if self._indent and "\n" in text:
+            text = text.replace("\n", self._newline)
+
+        self._has_output = True
+        self._buffer.append(text)
+        if len(self._buffer) >= self._FLUSH_THRESHOLD:
+            self.flush()
+
+    def _set_indent(self, indent: str) -> None:
+        self._indent = indent
+        self._newline = "\n" + indent
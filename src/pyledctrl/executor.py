@@ -1,10 +1,21 @@
 """Executor for abstract syntax trees generated by the LedCtrl compiler."""
 
 from decimal import Decimal, ROUND_DOWN, ROUND_UP
-from itertools import chain, count, groupby
+from itertools import chain, groupby
 from numbers import Number
 from operator import attrgetter
-from typing import ClassVar, Iterable, NamedTuple, Optional, TypeVar, Union
+from typing import (
+    Callable,
+    ClassVar,
+    Dict,
+    Iterable,
+    List,
+    NamedTuple,
+    Optional,
+    Tuple,
+    TypeVar,
+    Union,
+)
 
 from .compiler.ast import (
     Duration,
@@ -14,6 +25,7 @@ from .compiler.ast import (
     FadeToGrayCommand,
     FadeToWhiteCommand,
     LoopBlock,
+    Node,
     SetBlackCommand,
     SetColorCommand,
     SetGrayCommand,
@@ -24,7 +36,7 @@ from .compiler.ast import (
 )
 from .utils import consecutive_pairs, last
 
-__all__ = ("Color", "ExecutorState", "Executor")
+__all__ = ("Color", "ExecutorSnapshot", "ExecutorState", "Executor")
 
 
 _Color = NamedTuple("Color", [("red", int), ("green", int), ("blue", int)])
@@ -136,6 +148,53 @@ class ExecutorState:
         )
 
 
+class ExecutorSnapshot(NamedTuple):
+    """Compact snapshot of the position of an executor in a light program,
+    from which the execution of the same program can be resumed without
+    executing the program from the start.
+
+    Snapshots consist of numbers, booleans and tuples only, so they can be
+    pickled easily. Timestamps are decimal numbers; when storing snapshots in
+    JSON format, convert the timestamp to a string to keep it exact. Plain
+    lists of the same structure (e.g., snapshots loaded from JSON) are also
+    accepted when resuming an execution.
+    """
+
+    path: Tuple[Tuple[int, int], ...]
+    """The position of the executor in the nested sequences and loops of the
+    light program, from the outermost to the innermost. Each item is a pair
+    consisting of the number of statements started in the current iteration
+    of the sequence or loop, and the number of iterations completed. An
+    empty path means that the program has ended.
+    """
+
+    timestamp: Decimal
+    """The timestamp of the executor before the current command, in
+    seconds.
+    """
+
+    color: Tuple[int, int, int]
+    """The color of the executor before the current command."""
+
+    is_fade: bool
+    """Whether the executor was in the middle of a fade before the current
+    command.
+    """
+
+    skip: int = 0
+    """The number of events of the current command that were already yielded
+    before the snapshot was taken.
+    """
+
+
+_Frame = List
+"""Type alias for the frames of the loop stack of an executor. Each frame is
+a list consisting of the statements of a sequence or loop body, the number of
+statements started in the current iteration, the number of iterations
+completed and the total number of iterations (zero for infinite loops).
+"""
+
+
 class StopExecution(Exception):
     """Exception raised by an executor to stop execution."""
 
@@ -168,8 +227,15 @@ class Executor:
         Creates a virtual LED strip set to black color at timestamp zero.
         """
         self.state = ExecutorState()
-
-    def execute(self, node) -> Iterable[ExecutorState]:
+        self._stack: List[_Frame] = []
+        self._command: Optional[Node] = None
+        self._command_state = self.state
+        self._num_yielded = 0
+        self._handlers: Dict[type, Callable[[Node], Iterable[ExecutorState]]] = {}
+
+    def execute(
+        self, node, snapshot: Optional[ExecutorSnapshot] = None
+    ) -> Iterable[ExecutorState]:
         """Executes the command(s) in the given abstract syntax tree node
         and updates the state accordingly, yielding the state after every
         timestamp change.
@@ -177,21 +243,164 @@ class Executor:
         Note that the state is copied before it is yielded back to the caller,
         so it is safe to mutate the state object outside the executor; it will
         not affect the executor itself.
+
+        Parameters:
+            node: the abstract syntax tree node to execute
+            snapshot: optional snapshot of an earlier execution of the same
+                node, as returned from ``snapshot()``. When it is given, the
+                execution resumes from the snapshot and yields only those
+                states that the earlier execution has not yielded yet.
+
+        Raises:
+            ValueError: if the snapshot does not belong to the given node
         """
+        if snapshot is None:
+            self._stack = [self._create_frame(node)]
+            self._command = None
+        else:
+            self._restore(node, snapshot)
+
+        return self._run()
+
+    def _run(self) -> Iterable[ExecutorState]:
+        stack = self._stack
         try:
-            for state in self._execute(node):
-                yield state.copy()
+            while True:
+                command = self._command
+                if command is None:
+                    command = self._next_command()
+                    if command is None:
+                        break
+                    self._command = command
+                    self._command_state = self.state.copy()
+                    self._num_yielded = 0
+
+                # Commands yield only a few states so we can collect them
+                # all; this way the snapshot of the executor never needs to
+                # refer to the middle of a command handler
+                states = [state.copy() for state in self._execute(command)]
+                while self._num_yielded < len(states):
+                    self._num_yielded += 1
+                    yield states[self._num_yielded - 1]
+
+                self._command = None
         except StopExecution:
-            pass
+            stack.clear()
+            self._command = None
+
+    def snapshot(self) -> ExecutorSnapshot:
+        """Returns a snapshot of the current position of the executor in the
+        light program that it is executing.
+
+        The snapshot may be passed to ``execute()`` later, with the same
+        abstract syntax tree, to resume the execution right after the last
+        state that the executor has yielded before the snapshot was taken.
+        Restoring a snapshot takes time proportional to the nesting depth of
+        the loops in the light program only, so snapshots taken at regular
+        intervals may also be used to split a long light program into chunks
+        that are processed independently.
+        """
+        if self._command is None:
+            state, skip = self.state, 0
+        else:
+            state, skip = self._command_state, self._num_yielded
+
+        return ExecutorSnapshot(
+            path=tuple((frame[1], frame[2]) for frame in self._stack),
+            timestamp=state.timestamp,
+            color=state.color,
+            is_fade=state.is_fade,
+            skip=skip,
+        )
+
+    def _create_frame(self, node) -> _Frame:
+        if isinstance(node, StatementSequence):
+            return [node.statements, 0, 0, 1]
+        elif isinstance(node, LoopBlock):
+            return [node.body.statements, 0, 0, max(node.iterations.value, 0)]
+        else:
+            return [(node,), 0, 0, 1]
+
+    def _next_command(self) -> Optional[Node]:
+        """Advances the loop stack of the executor to the next command that
+        is not a sequence or a loop, and returns it. Returns ``None`` if the
+        light program has ended.
+        """
+        stack = self._stack
+        while stack:
+            frame = stack[-1]
+            statements, index = frame[0], frame[1]
+            if index >= len(statements):
+                frame[2] += 1
+                if not statements or frame[2] == frame[3]:
+                    stack.pop()
+                    continue
+                index = 0
+
+            frame[1] = index + 1
+            statement = statements[index]
+            if isinstance(statement, (StatementSequence, LoopBlock)):
+                stack.append(self._create_frame(statement))
+            else:
+                return statement
+
+        return None
+
+    def _restore(self, node, snapshot: ExecutorSnapshot) -> None:
+        """Restores the loop stack and the state of the executor from the
+        given snapshot, which may also be a plain tuple or list of the same
+        structure (e.g., one loaded from JSON).
+        """
+        path, timestamp, color, is_fade, skip = ExecutorSnapshot(*snapshot)
+
+        stack: List[_Frame] = []
+        command = None
+        statement = node
+        for depth, (index, iteration) in enumerate(path):
+            if depth and not isinstance(statement, (StatementSequence, LoopBlock)):
+                raise ValueError("snapshot does not match the light program")
+
+            frame = self._create_frame(statement)
+            statements = frame[0]
+            if (
+                index < 0
+                or index > len(statements)
+                or iteration < 0
+                or (frame[3] and iteration >= frame[3])
+            ):
+                raise ValueError("snapshot does not match the light program")
+
+            frame[1], frame[2] = index, iteration
+            stack.append(frame)
+            statement = statements[index - 1] if index else None
+
+        if stack and statement is not None:
+            if isinstance(statement, (StatementSequence, LoopBlock)):
+                raise ValueError("snapshot does not match the light program")
+            command = statement
+
+        self._stack = stack
+        self._command = command
+        if not isinstance(timestamp, Decimal):
+            timestamp = Decimal(str(timestamp))
+
+        self._command_state = ExecutorState(
+            timestamp=timestamp, color=Color(*color), is_fade=bool(is_fade)
+        )
+        self._num_yielded = skip if command is not None else 0
+        self.state = self._command_state.copy()
 
     def _execute(self, node):
-        class_name = node.__class__.__name__
-        method = getattr(self, "_execute_{0}".format(class_name), None)
+        handlers = self._handlers
+        method = handlers.get(node.__class__)
         if method is None:
-            raise RuntimeError("cannot execute {0}".format(class_name))
+            class_name = node.__class__.__name__
+            method = getattr(self, "_execute_{0}".format(class_name), None)
+            if method is None:
+                raise RuntimeError("cannot execute {0}".format(class_name))
+            handlers[node.__class__] = method
 
-        for state in method(node):
-            yield state
+        return method(node)
 
     def _execute_EndCommand(self, node: EndCommand) -> Iterable[ExecutorState]:
         raise StopExecution()
@@ -227,16 +436,6 @@ class Executor:
         for state in self._fade_to(Color.white(), node.duration):
             yield state
 
-    def _execute_LoopBlock(self, node: LoopBlock) -> Iterable[ExecutorState]:
-        num_iterations = node.iterations.value
-        if num_iterations > 0:
-            iterator = range(num_iterations)
-        else:
-            iterator = count()
-        for i in iterator:
-            for state in self._execute(node.body):
-                yield state
-
     def _execute_SetBlackCommand(
         self, node: SetBlackCommand
     ) -> Iterable[ExecutorState]:
@@ -267,13 +466,6 @@ class Executor:
         yield self.state
         self.state.advance_time_by(node.duration)
 
-    def _execute_StatementSequence(
-        self, node: StatementSequence
-    ) -> Iterable[ExecutorState]:
-        for statement in node.statements:
-            for state in self._execute(statement):
-                yield state
-
     def _execute_SleepCommand(self, node: SleepCommand) -> Iterable[ExecutorState]:
         self.state.advance_time_by(node.duration)
         self.state.is_fade = False
@@ -282,11 +474,13 @@ class Executor:
     def _execute_WaitUntilCommand(
         self, node: WaitUntilCommand
     ) -> Iterable[ExecutorState]:
-        new_timestamp = node.timestamp.value
+        # Timestamps of WAIT_UNTIL commands are given in frames
+        new_timestamp = node.timestamp.value / Duration.FPS
         self.state.timestamp = max(self.state.timestamp, new_timestamp)
         self.state.is_fade = False
         yield self.state
 
+    _execute_Comment = do_nothing
     _execute_NopCommand = do_nothing
     _execute_SetPyroCommand = do_nothing
     _execute_SetPyroAllCommand = do_nothing
@@ -0,0 +1,432 @@
+"""Exporters that write the light programs of all the drones in a show in
+formats that are convenient for external analysis tools.
+"""
+
+from array import array
+from bisect import bisect_left
+from concurrent.futures import ProcessPoolExecutor
+from contextlib import ExitStack
+from fractions import Fraction
+from itertools import chain
+from math import ceil, floor
+from os import PathLike
+from queue import Queue
+from sys import byteorder
+from threading import Thread
+from typing import (
+    IO,
+    Dict,
+    Iterable,
+    List,
+    NamedTuple,
+    Optional,
+    Sequence,
+    Tuple,
+    Union,
+)
+from zipfile import ZIP_DEFLATED, ZIP_STORED, ZipFile
+
+from .archive import ShowArchive
+from .compiler.ast import Duration
+from .parsers.bytecode import Buffer
+from .player import Player
+
+__all__ = ("export_rgb_stream", "export_segments_to_npz")
+
+
+_UINT32 = "I" if array("I").itemsize == 4 else "L"
+"""Type code of unsigned 32-bit integers in the array_ module."""
+
+_REBUILD_RATIO = 6
+"""RGB frames are rebuilt from scratch instead of patching the previous frame
+if more than one in this many drones were refreshed. Patching takes roughly
+this many times longer per drone than rebuilding.
+"""
+
+
+class _Columns(NamedTuple):
+    """Columns of the segments of a single light program or drone."""
+
+    start: array
+    end: array
+    start_color: bytes
+    end_color: bytes
+    is_fade: bytes
+
+
+def _ensure_archive(show: Union[ShowArchive, Iterable[Buffer]]) -> ShowArchive:
+    """Converts a list of light programs in compiled bytecode format into an
+    archive, one drone per light program. Archives are returned intact.
+    """
+    if isinstance(show, ShowArchive):
+        return show
+
+    archive = ShowArchive()
+    for program in show:
+        archive.add_drone(program)
+    return archive
+
+
+def _get_program_columns(bytecode: Buffer, until: Optional[int] = None) -> _Columns:
+    """Returns the columns of the segments in the flattened timeline of the
+    given light program, optionally limited to the segments that start before
+    the given frame.
+
+    This function is run in worker processes so it takes and returns plain,
+    picklable objects only.
+    """
+    starts, ends = array("q"), array("q")
+    start_colors, end_colors, fades = bytearray(), bytearray(), bytearray()
+    for segment in Player.from_bytes(bytecode).timeline(until):
+        starts.append(segment.start)
+        ends.append(segment.end)
+        start_colors += bytes(segment.start_color)
+        end_colors += bytes(segment.end_color)
+        fades.append(segment.is_fade)
+    return _Columns(starts, ends, bytes(start_colors), bytes(end_colors), bytes(fades))
+
+
+def _get_program_limits(archive: ShowArchive, horizon: int) -> List[int]:
+    """Returns the frame of each light program in the given archive until
+    which its timeline is needed, such that the timelines of all the drones
+    contain all the segments that start before the given frame of the show.
+    """
+    limits = [0] * len(archive.programs)
+    for drone in archive.drones:
+        # One extra frame for the rounding in _map_frames()
+        limit = ceil((horizon - drone.offset) * drone.rate) + 1
+        limits[drone.program] = max(limits[drone.program], limit)
+    return limits
+
+
+def _map_frames(frames: array, offset: int, rate: Fraction) -> array:
+    """Maps the frames of a light program to the frames of a drone that plays
+    the light program with the given start offset and playback rate, rounding
+    to the nearest frame.
+    """
+    if rate == 1:
+        return array("q", [frame + offset for frame in frames]) if offset else frames
+
+    num, den = rate.numerator, rate.denominator
+    return array(
+        "q", [offset + (2 * frame * den + num) // (2 * num) for frame in frames]
+    )
+
+
+def _write_npy(
+    archive: ZipFile, name: str, dtype: str, shape: Tuple[int, ...], data
+) -> None:
+    """Writes a single array in ``.npy`` format into a ``.npz`` archive.
+
+    Parameters:
+        archive: the archive to write to
+        name: the name of the array in the archive
+        dtype: the NumPy type descriptor of the items in the array
+        shape: the shape of the array
+        data: the items of the array in C order, as an array_ object or a
+            bytes-like object
+    """
+    if isinstance(data, array) and data.itemsize > 1 and byteorder == "big":
+        data = array(data.typecode, data)
+        data.byteswap()
+
+    header = "{{'descr': '{0}', 'fortran_order': False, 'shape': {1!r}, }}".format(
+        dtype, shape
+    )
+    # The magic string, the version and the length of the header take 10
+    # bytes; the header is padded so the data is aligned to 64 bytes
+    padding = -(10 + len(header) + 1) % 64
+    header_bytes = (header + " " * padding + "\n").encode("latin1")
+
+    with archive.open(name + ".npy", "w", force_zip64=True) as fp:
+        fp.write(b"\x93NUMPY\x01\x00")
+        fp.write(len(header_bytes).to_bytes(2, "little"))
+        fp.write(header_bytes)
+        fp.write(memoryview(data).cast("B"))
+
+
+def export_segments_to_npz(
+    show: Union[ShowArchive, Iterable[Buffer]],
+    output: Union[str, PathLike, IO[bytes]],
+    *,
+    compress: bool = False,
+    workers: Optional[int] = None,
+    duration: Optional[float] = None,
+) -> int:
+    """Exports the flattened timelines of all the drones in a show as columnar
+    data in NumPy's ``.npz`` format.
+
+    The file is written with the standard library only; it can be loaded
+    with ``numpy.load()``. It contains one row per segment, grouped by drone
+    and ordered by start frame within each drone, in the following arrays:
+
+    - ``drone``: the index of the drone (``uint32``)
+    - ``start_frame`` and ``end_frame``: the frames where the segment starts
+      and ends, at ``Duration.FPS`` frames per second, including the start
+      offset and playback rate of the drone (``int64``)
+    - ``start_color`` and ``end_color``: the RGB colors at the start and at
+      the end of the segment (``uint8``, one row of three per segment)
+    - ``is_fade``: whether the color fades linearly in the segment (``bool``)
+    - ``drone_rows``: the index of the first row of each drone, followed by
+      the total number of rows (``int64``), so the rows of drone *i* are
+      ``drone_rows[i]:drone_rows[i + 1]``
+
+    Parameters:
+        show: the show to export; either an archive or the light programs of
+            the drones in compiled bytecode format
+        output: the name of the output file or a writable binary stream
+        compress: whether to compress the arrays in the output
+        workers: the number of worker processes to use for evaluating the
+            light programs; ``None`` means one per CPU core, 1 evaluates the
+            light programs in the current process. Each distinct light
+            program is evaluated only once, regardless of the number of
+            drones that share it.
+        duration: the duration of the show to export, in seconds; segments
+            that start at or after the end of the duration are omitted.
+            ``None`` means to export all the segments until the light programs
+            end; a duration is required if any of the light programs contains
+            an infinite loop.
+
+    Returns:
+        the number of rows in the output
+
+    Raises:
+        ValueError: if no duration was given and one of the light programs
+            never ends
+    """
+    show = _ensure_archive(show)
+    programs = [bytes(program) for program in show.programs]
+    if duration is None:
+        horizon = None
+        limits: List[Optional[int]] = [None] * len(programs)
+    else:
+        horizon = max(ceil(duration * float(Duration.FPS)), 0)
+        limits = _get_program_limits(show, horizon)  # type: ignore
+
+    if workers == 1 or len(programs) < 2:
+        program_columns = [
+            _get_program_columns(program, limit)
+            for program, limit in zip(programs, limits)
+        ]
+    else:
+        with ProcessPoolExecutor(max_workers=workers) as executor:
+            program_columns = list(
+                executor.map(_get_program_columns, programs, limits, chunksize=16)
+            )
+
+    drone_ids, starts, ends = array(_UINT32), array("q"), array("q")
+    start_colors, end_colors, fades = bytearray(), bytearray(), bytearray()
+    drone_rows: List[int] = [0]
+
+    for index, drone in enumerate(show.drones):
+        columns = program_columns[drone.program]
+        drone_starts = _map_frames(columns.start, drone.offset, drone.rate)
+        drone_ends = _map_frames(columns.end, drone.offset, drone.rate)
+        count = len(drone_starts)
+        if horizon is not None:
+            count = bisect_left(drone_starts, horizon)
+            drone_starts, drone_ends = drone_starts[:count], drone_ends[:count]
+
+        drone_ids.extend(array(_UINT32, [index]) * count)
+        starts.extend(drone_starts)
+        ends.extend(drone_ends)
+        start_colors += columns.start_color[: 3 * count]
+        end_colors += columns.end_color[: 3 * count]
+        fades += columns.is_fade[:count]
+        drone_rows.append(len(starts))
+
+    num_rows = len(starts)
+    with ZipFile(output, "w", ZIP_DEFLATED if compress else ZIP_STORED) as archive:
+        _write_npy(archive, "drone", "<u4", (num_rows,), drone_ids)
+        _write_npy(archive, "start_frame", "<i8", (num_rows,), starts)
+        _write_npy(archive, "end_frame", "<i8", (num_rows,), ends)
+        _write_npy(archive, "start_color", "|u1", (num_rows, 3), start_colors)
+        _write_npy(archive, "end_color", "|u1", (num_rows, 3), end_colors)
+        _write_npy(archive, "is_fade", "|b1", (num_rows,), fades)
+        _write_npy(
+            archive, "drone_rows", "<i8", (len(drone_rows),), array("q", drone_rows)
+        )
+
+    return num_rows
+
+
+def _get_duration(archive: ShowArchive) -> float:
+    """Returns the time when the light program of the last drone of the given
+    archive ends, in seconds.
+
+    Raises:
+        ValueError: if the light program of one of the drones never ends
+    """
+    # Index of the first drone of each light program that is in use
+    users: Dict[int, int] = {}
+    for index, drone in enumerate(archive.drones):
+        users.setdefault(drone.program, index)
+
+    program_ends = []
+    for index, program in enumerate(archive.programs):
+        end = 0
+        if index in users:
+            player = Player.from_bytes(program)
+            if player.is_infinite:
+                raise ValueError(
+                    "light program of drone {0} never ends; the duration of "
+                    "the stream must be given".format(users[index])
+                )
+            for segment in player.timeline():
+                end = segment.end
+        program_ends.append(end)
+
+    return max(
+        (
+            drone.offset + program_ends[drone.program] / drone.rate
+            for drone in archive.drones
+        ),
+        default=0,
+    ) / float(Duration.FPS)
+
+
+def _write_frames(output: IO[bytes], filled: Queue, free: Queue, errors: list):
+    """Writes the frame buffers posted to the ``filled`` queue into the given
+    stream and returns them to the ``free`` queue, until ``None`` is posted.
+    The first error raised while writing is stored in ``errors``; subsequent
+    frames are not written but the buffers are still returned.
+    """
+    while True:
+        buffer = filled.get()
+        if buffer is None:
+            break
+        if not errors:
+            try:
+                output.write(buffer)
+            except Exception as ex:
+                errors.append(ex)
+        free.put(buffer)
+
+    if not errors:
+        try:
+            output.flush()
+        except Exception as ex:
+            errors.append(ex)
+
+
+def export_rgb_stream(
+    show: Union[ShowArchive, Iterable[Buffer]],
+    output: Union[str, PathLike, IO[bytes]],
+    *,
+    fps: int = 25,
+    duration: Optional[float] = None,
+    order: Optional[Sequence[int]] = None,
+    tolerance: float = 0,
+) -> int:
+    """Plays the light programs of all the drones in a show and writes their
+    colors as a raw stream of RGB frames, e.g., for LED walls or video tools
+    that mirror the colors of the drones.
+
+    Each frame consists of three bytes (red, green, blue) per drone, with no
+    headers or separators; frame *i* belongs to the timestamp *i* / *fps*.
+    Frames are produced incrementally by a SwarmPlayer_, so only the drones
+    whose colors change are evaluated again for each frame. When only a few
+    drones change, the previous frame is copied and patched; otherwise the
+    frame is rebuilt from the colors of all the drones in one go. Frames are
+    double-buffered and written by a separate thread so the playback of the
+    next frame overlaps with writing the previous one.
+
+    Parameters:
+        show: the show to play; either an archive or the light programs of
+            the drones in compiled bytecode format
+        output: the name of the output file or a writable binary stream
+            (e.g., a pipe)
+        fps: the number of frames per second
+        duration: the duration of the stream, in seconds; ``None`` means to
+            stop when the light program of the last drone ends, which is
+            allowed only if none of the light programs contains an infinite
+            loop. The stream also contains the frame at the end of the
+            duration.
+        order: the indices of the drones in the order they should appear in
+            each frame; ``None`` means the order of the drones in the show.
+            Drones may be omitted or repeated.
+        tolerance: the error budget of the swarm player; the largest
+            difference in any of the color channels between the written
+            colors and the exact colors of the drones
+
+    Returns:
+        the number of frames written
+
+    Raises:
+        ValueError: if the frame rate is not positive, the order refers to
+            drones that do not exist, or no duration was given and one of the
+            light programs never ends
+    """
+    if fps <= 0:
+        raise ValueError("frame rate must be positive")
+
+    show = _ensure_archive(show)
+    num_drones = len(show)
+    if duration is None:
+        duration = _get_duration(show)
+    num_frames = floor(duration * fps) + 1 if duration >= 0 else 0
+
+    # Byte offsets of the slots of each drone in a frame
+    if order is None:
+        offsets: List[Tuple[int, ...]] = [(index * 3,) for index in range(num_drones)]
+        num_slots = num_drones
+    else:
+        order = list(order)
+        slots: List[List[int]] = [[] for _ in range(num_drones)]
+        for position, index in enumerate(order):
+            if not 0 <= index < num_drones:
+                raise ValueError("invalid drone index in order: {0}".format(index))
+            slots[index].append(position * 3)
+        offsets = [tuple(drone_slots) for drone_slots in slots]
+        num_slots = len(order)
+    frame_size = num_slots * 3
+
+    swarm = show.create_swarm_player()
+
+    # Two frame buffers: one is filled while the other one is written
+    free: Queue = Queue()
+    filled: Queue = Queue(maxsize=1)
+    for _ in range(2):
+        free.put(bytearray(frame_size))
+    previous = None
+    errors: list = []
+
+    with ExitStack() as stack:
+        if isinstance(output, (str, PathLike)):
+            output = stack.enter_context(open(output, "wb"))
+
+        writer = Thread(
+            target=_write_frames, args=(output, filled, free, errors), daemon=True
+        )
+        writer.start()
+
+        try:
+            for frame in range(num_frames):
+                if errors:
+                    break
+
+                buffer = free.get()
+                colors, refreshed = swarm.sample(frame / fps, tolerance)
+
+                if previous is None or len(refreshed) * _REBUILD_RATIO > num_slots:
+                    # Rebuilding the frame needs no Python code per drone
+                    if order is not None:
+                        colors = map(colors.__getitem__, order)
+                    buffer[:] = bytes(chain.from_iterable(colors))
+                else:
+                    buffer[:] = previous
+                    for index in refreshed:
+                        color = colors[index]
+                        for offset in offsets[index]:
+                            buffer[offset : offset + 3] = color
+
+                filled.put(buffer)
+                previous = buffer
+        finally:
+            filled.put(None)
+            writer.join()
+
+    if errors:
+        raise errors[0]
+
+    return num_frames
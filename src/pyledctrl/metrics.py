@@ -0,0 +1,255 @@
+"""Lightweight runtime metrics of the player and the executor.
+
+Metrics are collected into a registry only while the registry is enabled.
+The default registry of the module is disabled so the instrumented code paths
+cost nothing in production unless metrics are explicitly asked for::
+
+    from pyledctrl.metrics import registry
+
+    registry.enable()
+    ...
+    print(registry.to_prometheus())
+
+Player cursors check whether the registry is enabled at each query, so the
+registry can be enabled at any time, also for players created earlier.
+Updates are not synchronized between threads; counts may be slightly
+off when several threads update the same metric at the same time.
+"""
+
+from bisect import bisect_left
+from typing import Any, Dict, Iterable, List, Optional, Sequence, Tuple, Union
+
+__all__ = ("Counter", "Histogram", "MetricsRegistry", "registry")
+
+
+LATENCY_BUCKETS: Tuple[float, ...] = (
+    1e-6,
+    2.5e-6,
+    5e-6,
+    1e-5,
+    2.5e-5,
+    5e-5,
+    1e-4,
+    2.5e-4,
+    5e-4,
+    1e-3,
+    2.5e-3,
+    5e-3,
+    1e-2,
+    2.5e-2,
+    5e-2,
+    0.1,
+)
+"""Default bucket boundaries of histograms that measure durations, in
+seconds.
+"""
+
+DISTANCE_BUCKETS: Tuple[float, ...] = (1, 2, 4, 8, 16, 32, 64, 128, 256, 1024, 4096)
+"""Default bucket boundaries of histograms that measure distances."""
+
+
+class Counter:
+    """Metric that counts the occurrences of some event."""
+
+    __slots__ = ("name", "help", "value")
+
+    name: str
+    """The name of the counter."""
+
+    help: str
+    """Short description of the counter."""
+
+    value: Union[int, float]
+    """The current value of the counter."""
+
+    def __init__(self, name: str, help: str = ""):
+        self.name = name
+        self.help = help
+        self.value = 0
+
+    def inc(self, amount: Union[int, float] = 1) -> None:
+        """Increases the counter by the given amount."""
+        self.value += amount
+
+    def reset(self) -> None:
+        """Resets the counter to zero."""
+        self.value = 0
+
+
+class Histogram:
+    """Metric that counts observed values in buckets, along with the sum and
+    the number of observed values.
+    """
+
+    __slots__ = ("name", "help", "buckets", "counts", "sum", "count")
+
+    name: str
+    """The name of the histogram."""
+
+    help: str
+    """Short description of the histogram."""
+
+    buckets: Tuple[float, ...]
+    """The upper bounds of the buckets of the histogram, in increasing
+    order, excluding the implicit last bucket with an infinite upper bound.
+    """
+
+    counts: List[int]
+    """The number of observed values in each bucket (not cumulative); the
+    last item belongs to the implicit bucket with an infinite upper bound.
+    """
+
+    sum: float
+    """The sum of the observed values."""
+
+    count: int
+    """The number of observed values."""
+
+    def __init__(self, name: str, help: str = "", buckets: Iterable[float] = ()):
+        self.name = name
+        self.help = help
+        self.buckets = tuple(sorted(float(bound) for bound in buckets))
+        self.reset()
+
+    def observe(self, value: float) -> None:
+        """Records an observed value in the histogram."""
+        self.counts[bisect_left(self.buckets, value)] += 1
+        self.sum += value
+        self.count += 1
+
+    def reset(self) -> None:
+        """Removes all the observed values from the histogram."""
+        self.counts = [0] * (len(self.buckets) + 1)
+        self.sum = 0.0
+        self.count = 0
+
+    def cumulative_counts(self) -> List[Tuple[float, int]]:
+        """Returns the upper bounds of the buckets (including the infinite
+        one) and the number of observed values not larger than each bound.
+        """
+        result, total = [], 0
+        for bound, count in zip(self.buckets + (float("inf"),), self.counts):
+            total += count
+            result.append((bound, total))
+        return result
+
+
+class MetricsRegistry:
+    """Registry of metrics that can be exported as a dictionary or in the
+    text exposition format of Prometheus.
+    """
+
+    enabled: bool
+    """Whether the instrumented code paths should collect metrics into this
+    registry.
+    """
+
+    def __init__(self, enabled: bool = False):
+        """Constructor.
+
+        Parameters:
+            enabled: whether the registry is enabled initially
+        """
+        self.enabled = bool(enabled)
+        self._metrics: Dict[str, Union[Counter, Histogram]] = {}
+
+    def enable(self) -> None:
+        """Enables the collection of metrics into this registry."""
+        self.enabled = True
+
+    def disable(self) -> None:
+        """Disables the collection of metrics into this registry. Metrics
+        collected so far are kept.
+        """
+        self.enabled = False
+
+    def counter(self, name: str, help: str = "") -> Counter:
+        """Returns the counter with the given name, creating it if needed."""
+        metric = self._metrics.get(name)
+        if metric is None:
+            metric = self._metrics[name] = Counter(name, help)
+        elif not isinstance(metric, Counter):
+            raise ValueError("{0!r} is not a counter".format(name))
+        return metric
+
+    def histogram(
+        self, name: str, help: str = "", buckets: Optional[Sequence[float]] = None
+    ) -> Histogram:
+        """Returns the histogram with the given name, creating it with the
+        given buckets if needed.
+        """
+        metric = self._metrics.get(name)
+        if metric is None:
+            metric = self._metrics[name] = Histogram(
+                name, help, LATENCY_BUCKETS if buckets is None else buckets
+            )
+        elif not isinstance(metric, Histogram):
+            raise ValueError("{0!r} is not a histogram".format(name))
+        return metric
+
+    def reset(self) -> None:
+        """Resets all the metrics in the registry."""
+        for metric in self._metrics.values():
+            metric.reset()
+
+    def as_dict(self) -> Dict[str, Any]:
+        """Returns the current values of all the metrics in the registry.
+
+        Counters are mapped to their values. Histograms are mapped to
+        dictionaries with ``count``, ``sum`` and ``buckets`` keys, where
+        ``buckets`` maps the upper bound of each bucket to the cumulative
+        number of observed values.
+        """
+        result: Dict[str, Any] = {}
+        for name, metric in sorted(self._metrics.items()):
+            if isinstance(metric, Counter):
+                result[name] = metric.value
+            else:
+                result[name] = {
+                    "count": metric.count,
+                    "sum": metric.sum,
+                    "buckets": dict(metric.cumulative_counts()),
+                }
+        return result
+
+    def to_prometheus(self) -> str:
+        """Returns the current values of all the metrics in the registry in
+        the text exposition format of Prometheus.
+        """
+        lines = []
+        for name, metric in sorted(self._metrics.items()):
+            if metric.help:
+                lines.append("# HELP {0} {1}".format(name, _escape_help(metric.help)))
+            if isinstance(metric, Counter):
+                lines.append("# TYPE {0} counter".format(name))
+                lines.append("{0} {1}".format(name, _format_value(metric.value)))
+            else:
+                lines.append("# TYPE {0} histogram".format(name))
+                for bound, count in metric.cumulative_counts():
+                    lines.append(
+                        '{0}_bucket{{le="{1}"}} {2}'.format(
+                            name, _format_value(bound), count
+                        )
+                    )
+                lines.append("{0}_sum {1}".format(name, _format_value(metric.sum)))
+                lines.append("{0}_count {1}".format(name, metric.count))
+        return "".join(line + "\n" for line in lines)
+
+
+def _escape_help(text: str) -> str:
+    return text.replace("\\", "\\\\").replace("\n", "\\n")
+
+
+def _format_value(value: Union[int, float]) -> str:
+    if value == float("inf"):
+        return "+Inf"
+    elif isinstance(value, int):
+        return str(value)
+    else:
+        return repr(float(value))
+
+
+registry = MetricsRegistry()
+"""The default metrics registry that the player and the executor report to.
+Disabled by default.
+"""
@@ -1,12 +1,68 @@
 """Parser implementation for the LedCtrl bytecode format."""
 
-from io import BufferedReader, BytesIO
+from io import BufferedReader, RawIOBase
+from mmap import mmap
 from typing import IO, Union
 
 from pyledctrl.compiler.ast import StatementSequence
 from pyledctrl.compiler.errors import BytecodeParserError, BytecodeParserEOFError
 
-__all__ = ("BytecodeParser", "BytecodeParserError", "BytecodeParserEOFError")
+__all__ = (
+    "Buffer",
+    "BufferReader",
+    "BytecodeParser",
+    "BytecodeParserError",
+    "BytecodeParserEOFError",
+)
+
+
+Buffer = Union[bytes, bytearray, memoryview, mmap]
+"""Type alias for the in-memory buffer types that the parser accepts."""
+
+BUFFER_TYPES = (bytes, bytearray, memoryview, mmap)
+"""Tuple of the in-memory buffer types that the parser accepts, for
+``isinstance()`` checks.
+"""
+
+
+class BufferReader(RawIOBase):
+    """Raw, read-only stream over an in-memory buffer.
+
+    Unlike ``BytesIO``, the reader does not copy the buffer; it reads through
+    a memoryview_ of the buffer so slices of a large buffer (e.g., an
+    archive that was mapped into memory) can be parsed without copying them
+    first. Wrap the reader in a ``BufferedReader`` to get ``peek()`` support;
+    the buffered reader then copies only one small chunk of the buffer at a
+    time.
+    """
+
+    def __init__(self, buffer: Buffer):
+        """Constructor.
+
+        Parameters:
+            buffer: the buffer to read from. The buffer must not be modified
+                or closed while the reader is in use.
+        """
+        super().__init__()
+        view = memoryview(buffer)
+        if view.ndim != 1 or view.itemsize != 1:
+            view = view.cast("B")
+        self._view = view
+        self._pos = 0
+
+    def readable(self) -> bool:
+        return True
+
+    def readinto(self, buffer) -> int:
+        pos = self._pos
+        chunk = self._view[pos : pos + len(buffer)]
+        size = len(chunk)
+        buffer[:size] = chunk
+        self._pos = pos + size
+        return size
+
+    def tell(self) -> int:
+        return self._pos
 
 
 class BytecodeParser:
@@ -17,16 +73,20 @@ class BytecodeParser:
     human-readable "source code" of the compiled LedCtrl bytecode.
     """
 
-    def parse(self, fp: Union[bytes, IO[bytes]]):
+    def parse(self, fp: Union[Buffer, IO[bytes]]):
         """Parses the given input and returns a data structure that represents
         the parsed abstract syntax tree.
 
         Parameters:
-            fp (Union[bytes, IOBase]): the input to parse
+            fp (Union[Buffer, IOBase]): the input to parse; either an
+                in-memory buffer (bytes, bytearray, memoryview or mmap) that
+                is parsed without copying it, or a binary stream
 
         Returns:
             StatementSequence: the sequence of statements found in the input
         """
-        if isinstance(fp, bytes):
-            fp = BytesIO(fp)
-        return StatementSequence.from_bytecode(BufferedReader(fp))  # type: ignore
+        if isinstance(fp, BUFFER_TYPES):
+            fp = BufferReader(fp)
+        if not hasattr(fp, "peek"):
+            fp = BufferedReader(fp)  # type: ignore
+        return StatementSequence.from_bytecode(fp)  # type: ignore
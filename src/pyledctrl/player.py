@@ -3,44 +3,769 @@ program and that can tell the color of the light program at any given time
 instant.
 """
 
-from collections import deque
-from math import isfinite
-from typing import Iterator, Optional, Tuple
+from bisect import bisect_left, bisect_right
+from decimal import Decimal
+from fractions import Fraction
+from functools import partial
+from heapq import heapify, heappop, heappush
+from itertools import accumulate, chain, count, islice, repeat
+from math import gcd, inf, isfinite
+from threading import Lock
+from time import perf_counter
+from typing import Iterable, Iterator, List, NamedTuple, Optional, Tuple, Union
 
 from .compiler import compile
+from .compiler.ast import Duration, EndCommand, LoopBlock, StatementSequence
 from .compiler.formats import InputFormat, InputFormatLike
-from .executor import Color, Executor, ExecutorState
+from .executor import Color, Executor, ExecutorSnapshot, ExecutorState
+from .metrics import DISTANCE_BUCKETS, registry as _registry
+from .parsers.bytecode import Buffer
 
-__all__ = ("Player",)
+__all__ = ("Player", "PlayerCursor", "PlayerSnapshot", "Segment")
 
 
 _START = ExecutorState(timestamp=-0.00001, color=Color.BLACK)
 _END = ExecutorState(timestamp=float("inf"), color=Color.BLACK)
 
+Rate = Union[int, Fraction, Decimal, str]
+"""Type alias for objects that can be used to specify a frame rate, in
+frames per second; anything that can be converted into a Fraction_ exactly.
+"""
+
+_QUERIES = _registry.counter(
+    "pyledctrl_player_queries_total", "Number of color queries answered by cursors"
+)
+_REWINDS = _registry.counter(
+    "pyledctrl_player_rewinds_total",
+    "Number of queries earlier than the previous query of the same cursor",
+)
+_CURSOR_HITS = _registry.counter(
+    "pyledctrl_player_cursor_hits_total",
+    "Number of queries answered from the segment of the previous query",
+)
+_CURSOR_MISSES = _registry.counter(
+    "pyledctrl_player_cursor_misses_total",
+    "Number of queries that needed a search in the event log",
+)
+_SEEK_DISTANCE = _registry.histogram(
+    "pyledctrl_player_seek_distance_events",
+    "Number of events that cursors moved by when searching the event log",
+    DISTANCE_BUCKETS,
+)
+_QUERY_LATENCY = _registry.histogram(
+    "pyledctrl_player_query_seconds", "Time needed to answer color queries"
+)
+_EVENTS = _registry.counter(
+    "pyledctrl_player_events_total",
+    "Number of events consumed from executors into event logs",
+)
+_REPLAYS = _registry.counter(
+    "pyledctrl_player_replays_total",
+    "Number of times a light program was re-executed from a checkpoint",
+)
+
+
+def _to_frames(timestamp: Union[Decimal, float]) -> int:
+    """Converts a timestamp of an event, in seconds, to the index of the
+    corresponding frame at ``Duration.FPS`` frames per second. Negative
+    timestamps are mapped to -1.
+    """
+    if timestamp < 0:
+        return -1
+    if not isinstance(timestamp, Decimal):
+        timestamp = Decimal(str(timestamp))
+    return int((timestamp * Duration.FPS).to_integral_value())
+
+
+def _divide_and_round(numerator: int, denominator: int) -> int:
+    """Divides two integers and rounds the result to the nearest integer,
+    rounding halves to even like ``round()`` does.
+    """
+    quotient, remainder = divmod(numerator, denominator)
+    twice = remainder * 2
+    if twice > denominator or (twice == denominator and quotient % 2):
+        quotient += 1
+    return quotient
+
+
+def _mix_colors(start: Color, end: Color, numerator: int, denominator: int) -> Color:
+    """Mixes two colors with a mixing ratio given as the ratio of two
+    integers, using integer arithmetic only.
+    """
+    if numerator <= 0:
+        return start
+    elif numerator >= denominator:
+        return end
+
+    rest = denominator - numerator
+    return Color(
+        _divide_and_round(start.red * rest + end.red * numerator, denominator),
+        _divide_and_round(start.green * rest + end.green * numerator, denominator),
+        _divide_and_round(start.blue * rest + end.blue * numerator, denominator),
+    )
+
+
+_ENDS, _RUNS_FOREVER, _FALLS_THROUGH = range(3)
+
+
+def _get_outcome(statements) -> int:
+    """Returns what happens when the given list of statements of a light
+    program is executed: either the light program reaches an ``end()``
+    command (``_ENDS``), or it gets stuck in an infinite loop
+    (``_RUNS_FOREVER``), or the execution continues after the last statement
+    (``_FALLS_THROUGH``).
+
+    Light programs have no conditional statements and the body of a loop is
+    executed at least once, so the first of these that is reached decides
+    the outcome.
+    """
+    for statement in statements:
+        if isinstance(statement, EndCommand):
+            return _ENDS
+        elif isinstance(statement, LoopBlock):
+            body = statement.body.statements
+            if not body:
+                continue
+            outcome = _get_outcome(body)
+            if outcome != _FALLS_THROUGH:
+                return outcome
+            if statement.iterations.value <= 0:
+                return _RUNS_FOREVER
+        elif isinstance(statement, StatementSequence):
+            outcome = _get_outcome(statement.statements)
+            if outcome != _FALLS_THROUGH:
+                return outcome
+    return _FALLS_THROUGH
+
+
+def _get_frame_periods(rates: Iterable[Rate]) -> Tuple[List[int], int]:
+    """Given a list of frame rates, returns the periods of the frame rates,
+    expressed as integer multiples of a common time unit, and the number of
+    time units in a frame at ``Duration.FPS`` frames per second.
+    """
+    periods = []
+    for rate in rates:
+        rate = Fraction(rate)
+        if rate <= 0:
+            raise ValueError("frame rates must be positive")
+        periods.append(Fraction(Duration.FPS) / rate)
+
+    scale = 1
+    for period in periods:
+        scale = scale * period.denominator // gcd(scale, period.denominator)
+
+    return [int(period * scale) for period in periods], scale
+
+
+class Segment(NamedTuple):
+    """A segment of the flattened timeline of a light program between two
+    consecutive events, during which the color is either constant or fades
+    linearly from one color to another.
+    """
+
+    start: int
+    """The first frame of the segment, at ``Duration.FPS`` frames per
+    second.
+    """
+
+    end: int
+    """The frame where the segment ends and the next one begins."""
+
+    start_color: Color
+    """The color at the start of the segment."""
+
+    end_color: Color
+    """The color that the segment fades into at its end; the same as the
+    start color if the segment is not a fade.
+    """
+
+    is_fade: bool
+    """Whether the color fades linearly from the start color to the end
+    color in the segment.
+    """
+
+
+class PlayerSnapshot(NamedTuple):
+    """Compact snapshot of the playback position of a player, from which the
+    playback of the same light program can be resumed without executing the
+    program from the start.
+
+    Like ExecutorSnapshot_ objects, player snapshots consist of numbers,
+    booleans and tuples only so they can be pickled or stored in JSON format.
+    """
+
+    executor: ExecutorSnapshot
+    """Snapshot of the executor that produces the events of the light
+    program for the player.
+    """
+
+    events: Tuple[Tuple[float, Tuple[int, int, int], bool], ...]
+    """The last events produced by the executor before the snapshot was
+    taken, as timestamp-color-fade triplets. These are needed to tell the
+    color of the light program between the last event and the next one.
+    """
+
+
+class _EventLog:
+    """Log of the events of a light program, produced lazily by an Executor_
+    and shared by all the cursors of a player.
+
+    The log is extended only when a cursor asks for a timestamp beyond the
+    last event in the log. Extensions are serialized with a lock; reading
+    the log needs no locking because events are only ever appended to it.
+
+    By default, the log keeps all the events that were produced so far, so
+    its size is proportional to the latest timestamp that was queried; each
+    event takes about 230 bytes on 64-bit CPython. Logs with a retention
+    bound keep only the latest events in a window of at most twice the
+    bound, and store a checkpoint (a PlayerSnapshot_ of a few hundred bytes)
+    each time the bound is passed. The window only ever moves forward; it
+    is moved by replacing the lists of the log under the lock, so readers
+    must fetch the lists with ``get_window()``. Queries before the window are
+    answered from private replays of the light program (see ``replay()``)
+    that do not affect the shared window.
+    """
+
+    events: List[ExecutorState]
+    """The events in the log, starting with a sentinel event before zero
+    time (unless the log was restored from a snapshot or the window has
+    moved on) and ending with a sentinel event at infinity once the program
+    has ended.
+    """
+
+    timestamps: List[float]
+    """The timestamps of the events, in seconds."""
+
+    frames: List[int]
+    """The timestamps of the events, in frames at ``Duration.FPS`` frames
+    per second.
+    """
+
+    complete: bool
+    """Whether the program has ended and all its events are in the log."""
+
+    restored: bool
+    """Whether the log was restored from a snapshot, in which case it does
+    not contain the events before the snapshot.
+    """
+
+    max_events: Optional[int]
+    """The retention bound of the log; ``None`` if the log keeps all the
+    events.
+    """
+
+    generation: int
+    """Counter that is increased whenever the lists of the log are replaced
+    and the indices into the old lists become invalid.
+    """
+
+    position: int
+    """The number of events of the program before the first event in the
+    log.
+    """
+
+    def __init__(
+        self,
+        ast=None,
+        snapshot: Optional[PlayerSnapshot] = None,
+        max_events: Optional[int] = None,
+        *,
+        position: int = 0,
+        root: Optional["_EventLog"] = None,
+    ):
+        if ast is None:
+            ast = StatementSequence()
+        if max_events is not None and max_events < 2:
+            raise ValueError("event logs must be able to hold at least two events")
+
+        self._ast = ast
+        self._lock = Lock()
+        self._root = root or self
+        self.max_events = max_events
+        self.generation = 0
+        self.restored = snapshot is not None
+
+        self._start(position, snapshot)
+
+        if root is None:
+            # Positions, start timestamps, start frames and snapshots of the
+            # checkpoints that the log and its replays can be restarted from
+            self._checkpoints: List[
+                Tuple[int, float, int, Optional[PlayerSnapshot]]
+            ] = [(0, self.timestamps[0], self.frames[0], snapshot)]
+
+    def _start(self, position: int, snapshot: Optional[PlayerSnapshot]) -> None:
+        """Starts the execution of the light program from the beginning or
+        from the given snapshot, which belongs to the given position.
+        """
+        self._executor = Executor()
+        self.complete = False
+        self.position = position
+
+        if snapshot is None:
+            events = [_START]
+            self._event_iter = self._executor.execute(self._ast)
+        else:
+            executor_snapshot, snapshot_events = snapshot
+            if not snapshot_events:
+                raise ValueError("snapshot must contain at least one event")
+            events = [
+                ExecutorState(
+                    timestamp=float(timestamp), color=Color(*color), is_fade=is_fade
+                )
+                for timestamp, color, is_fade in snapshot_events
+            ]
+            self._event_iter = self._executor.execute(self._ast, executor_snapshot)
+
+        self.events = events
+        self.timestamps = [event.timestamp for event in events]
+        self.frames = [_to_frames(event.timestamp) for event in events]
+
+    def extend_beyond(self, timestamp: float) -> None:
+        """Extends the log until it contains an event that is later than the
+        given timestamp and at least two events, or until the program ends.
+        """
+        timestamps = self.timestamps
+        if not self.complete and (timestamps[-1] <= timestamp or len(timestamps) < 2):
+            with self._lock:
+                self._extend(False, timestamp)
+
+    def extend_beyond_frame(self, frame: int) -> None:
+        """Extends the log until it contains an event that is later than the
+        given frame and at least two events, or until the program ends.
+        """
+        frames = self.frames
+        if not self.complete and (frames[-1] <= frame or len(frames) < 2):
+            with self._lock:
+                self._extend(True, frame)
+
+    def get_window(
+        self, by_frame: bool, limit
+    ) -> Optional[Tuple[List[ExecutorState], List[float], List[int]]]:
+        """Extends a bounded log beyond the given timestamp or frame like
+        ``extend_beyond()`` and ``extend_beyond_frame()`` do, and returns
+        the events, the timestamps and the frames of the log, fetched
+        together under the lock so they always belong to the same window.
+
+        Returns:
+            the lists of the log, or ``None`` if the given timestamp or frame
+            is earlier than the window of the log
+        """
+        with self._lock:
+            keys = self.frames if by_frame else self.timestamps
+            if self.position and limit < keys[0]:
+                return None
+            self._extend(by_frame, limit)
+            return self.events, self.timestamps, self.frames
+
+    def replay(self, key: int, limit) -> "_EventLog":
+        """Creates a private replay of the light program, starting from the
+        latest checkpoint whose window starts not later than the given limit,
+        or from the first checkpoint if there is no such checkpoint.
+
+        The replay is a separate bounded log that shares the checkpoints of
+        this log but not its window, so it can be moved without affecting
+        the other users of this log. It must be used from one thread at a
+        time.
+
+        Parameters:
+            key: index of the item in the checkpoint tuples that the limit
+                is compared with; 0 for positions, 1 for timestamps, 2 for
+                frames
+            limit: the position, timestamp or frame that the replay must
+                contain
+        """
+        root = self._root
+        with root._lock:
+            checkpoints = root._checkpoints
+            index = bisect_right([item[key] for item in checkpoints], limit) - 1
+            position, _, _, snapshot = checkpoints[max(index, 0)]
+
+        if _registry.enabled:
+            _REPLAYS.inc()
+
+        return _EventLog(
+            self._ast, snapshot, self.max_events, position=position, root=root
+        )
+
+    def _extend(self, by_frame: bool, limit) -> None:
+        """Extends the log until it contains an event that is later than the
+        given timestamp or frame and at least two events, or until the
+        program ends. Must be called with the lock held.
+        """
+        events, frames, timestamps = self.events, self.frames, self.timestamps
+        keys = frames if by_frame else timestamps
+        max_events = self.max_events
+        added = 0
+
+        while not self.complete and (keys[-1] <= limit or len(keys) < 2):
+            event = next(self._event_iter, _END)
+            if event is _END:
+                frame = float("inf")
+            else:
+                frame = _to_frames(event.timestamp)
+                event.timestamp = float(event.timestamp)
+
+            # Events must be appended first and timestamps last so readers
+            # that see a new frame or timestamp can always access the
+            # corresponding event
+            events.append(event)
+            frames.append(frame)  # type: ignore
+            timestamps.append(event.timestamp)
+            added += 1
+
+            if event is _END:
+                self.complete = True
+            elif max_events is not None:
+                self._add_checkpoint_if_needed()
+
+            if max_events is not None and len(events) > 2 * max_events:
+                # Move the window; the lists are replaced so readers holding
+                # the old lists are not affected
+                drop = len(events) - max_events
+                events = self.events = events[drop:]
+                frames = self.frames = frames[drop:]
+                timestamps = self.timestamps = timestamps[drop:]
+                keys = frames if by_frame else timestamps
+                self.position += drop
+                self.generation += 1
+
+        if added and _registry.enabled:
+            _EVENTS.inc(added)
+
+    def _add_checkpoint_if_needed(self) -> None:
+        """Stores a checkpoint at the current end of a bounded log if the
+        previous checkpoint is at least ``max_events`` events earlier. Must
+        be called with the lock held.
+        """
+        position = self.position + len(self.events) - 2
+        root = self._root
+        if position < root._checkpoints[-1][0] + self.max_events:  # type: ignore
+            return
+
+        checkpoint = (position, self.timestamps[-2], self.frames[-2], self._snapshot())
+        if root is self:
+            self._checkpoints.append(checkpoint)
+        else:
+            # Replays that get ahead of the log store checkpoints for it
+            with root._lock:
+                if position >= root._checkpoints[-1][0] + self.max_events:
+                    root._checkpoints.append(checkpoint)
+
+    def snapshot(self) -> PlayerSnapshot:
+        """Returns a snapshot of the current state of the log, from which an
+        equivalent log can be restored later.
+        """
+        with self._lock:
+            return self._snapshot()
+
+    def _snapshot(self) -> PlayerSnapshot:
+        events = self.events[-3:-1] if self.complete else self.events[-2:]
+        return PlayerSnapshot(
+            executor=self._executor.snapshot(),
+            events=tuple(
+                (event.timestamp, event.color, event.is_fade) for event in events
+            ),
+        )
+
+
+class PlayerCursor:
+    """Lightweight cursor that answers queries about the colors of a light
+    program at arbitrary timestamps.
+
+    Cursors share the events of the light program with the player that
+    created them, and each cursor keeps track of its own position only.
+    Any number of cursors may look at different timestamps of the same
+    program without interfering with each other; cursors may also be used
+    from different threads, as long as each cursor is used by only one
+    thread at a time. When the player has a retention bound, cursors that
+    look at timestamps before the events retained by the player replay the
+    light program on their own from the nearest checkpoint.
+    """
+
+    __slots__ = ("_log", "_index", "_ended", "_window", "_replay", "_last_query")
+
+    def __init__(self, log: _EventLog):
+        """Constructor.
+
+        Do not call this constructor directly; use ``Player.cursor()``
+        instead.
+        """
+        self._log = log
+        self._index = 0
+        self._ended = False
+        self._window: Tuple[List[ExecutorState], List[float], List[int]] = (
+            [],
+            [],
+            [],
+        )
+        self._replay: Optional[_EventLog] = None
+        self._last_query = -inf
+
+    @property
+    def ended(self) -> bool:
+        """Returns whether the last query of the cursor was at or after the
+        end of the light program.
+        """
+        return self._ended
+
+    def get_color_at(self, timestamp: float) -> Color:
+        """Returns the color that the light program emits at the given
+        timestamp.
+        """
+        if _registry.enabled:
+            index, started_at = self._index, perf_counter()
+            color = self._find_color_at(timestamp)
+            self._record(timestamp, index, perf_counter() - started_at)
+            return color
+        return self._find_color_at(timestamp)
+
+    def _find_color_at(self, timestamp: float) -> Color:
+        if not isfinite(timestamp):
+            raise ValueError("infinite timestamp not supported")
+
+        log = self._log
+        if log.max_events is None:
+            log.extend_beyond(timestamp)
+            events, timestamps = log.events, log.timestamps
+        else:
+            events, timestamps, _ = self._get_window(False, timestamp)
+
+        # At this point, we can be sure that the log has at least two items
+        # and the last one is later than the timestamp. We need the last
+        # event that is not later than the timestamp. Optimize for the common
+        # case when the timestamp is close to the one in the previous query
+        index = self._index
+        if not timestamps[index] <= timestamp < timestamps[index + 1]:
+            index = bisect_right(timestamps, timestamp) - 1
+            if index < 0:
+                if log.restored:
+                    raise ValueError(
+                        "timestamp is earlier than the snapshot that the "
+                        "player was restored from"
+                    )
+                index = 0
+            self._index = index
+
+        # The program has ended if the sentinel event at infinity is present
+        if timestamps[-1] == inf:
+            self._ended = timestamp >= timestamps[-2]
+
+        start, end = events[index], events[index + 1]
+        if end.is_fade:
+            diff = end.timestamp - start.timestamp
+            ratio = (timestamp - start.timestamp) / diff
+            color = start.color.mix_with(end.color, ratio=ratio, integral=True)
+        else:
+            color = start.color
+
+        return color
+
+    def get_color_and_expiry_at(
+        self, timestamp: float, tolerance: float = 0
+    ) -> Tuple[Color, float]:
+        """Returns the color that the light program emits at the given
+        timestamp, and the earliest timestamp when the color of the light
+        program may differ from the returned color by more than the given
+        tolerance in any of its channels.
+
+        The expiry timestamp is derived from the segment of the light program
+        that contains the timestamp, i.e. the end of the segment or the time
+        when a fade in the segment has changed the color by more than the
+        tolerance, whichever comes first. The rounding of the returned color
+        to integers is not taken into account. The expiry timestamp is
+        infinite if the color never changes again.
+
+        Parameters:
+            timestamp: the timestamp to query
+            tolerance: the largest difference in any of the color channels
+                that is acceptable
+        """
+        color = self.get_color_at(timestamp)
+
+        log = self._log
+        if log.max_events is None:
+            events, timestamps = log.events, log.timestamps
+        else:
+            events, timestamps, _ = self._window
+
+        index = self._index
+        end_time = timestamps[index + 1]
+        end = events[index + 1]
+        if end.is_fade:
+            start = events[index]
+            delta = max(abs(x - y) for x, y in zip(start.color, end.color))
+            if delta > 0:
+                rate = delta / (end_time - start.timestamp)
+                end_time = min(end_time, timestamp + tolerance / rate)
+
+        return color, end_time
+
+    def get_color_at_frame(self, frame: int, fps: Optional[Rate] = None) -> Color:
+        """Returns the color that the light program emits at the given frame,
+        using integer arithmetic only.
+
+        Parameters:
+            frame: the index of the frame
+            fps: the frame rate that the frame index refers to, in frames per
+                second; ``None`` means ``Duration.FPS``, the frame rate of
+                the light program itself. Any rational number is accepted.
+        """
+        if fps is None:
+            return self._get_color_at_scaled_time(frame, 1)
+        else:
+            (period,), scale = _get_frame_periods((fps,))
+            return self._get_color_at_scaled_time(frame * period, scale)
+
+    def _get_color_at_scaled_time(self, time: int, scale: int) -> Color:
+        """Returns the color that the light program emits at the given time,
+        expressed in units of 1/scale frames at ``Duration.FPS`` frames per
+        second.
+        """
+        if _registry.enabled:
+            index, started_at = self._index, perf_counter()
+            color = self._find_color_at_scaled_time(time, scale)
+            self._record(
+                time / scale / float(Duration.FPS), index, perf_counter() - started_at
+            )
+            return color
+        return self._find_color_at_scaled_time(time, scale)
+
+    def _find_color_at_scaled_time(self, time: int, scale: int) -> Color:
+        frame = time // scale
+
+        log = self._log
+        if log.max_events is None:
+            log.extend_beyond_frame(frame)
+            events, frames = log.events, log.frames
+        else:
+            events, _, frames = self._get_window(True, frame)
+
+        # The log has at least two items and the last one is later than the
+        # frame. We need the last event that is not later than the frame.
+        # Searches start from the previous position of the cursor because
+        # consecutive queries tend to be close to each other
+        index = self._index
+        if frame < frames[index]:
+            index = bisect_right(frames, frame, 0, index) - 1
+            if index < 0:
+                if log.restored:
+                    raise ValueError(
+                        "frame is earlier than the snapshot that the "
+                        "player was restored from"
+                    )
+                index = 0
+            self._index = index
+        elif frame >= frames[index + 1]:
+            index = self._index = bisect_right(frames, frame, index + 1) - 1
+
+        if frames[-1] == inf:
+            self._ended = frame >= frames[-2]
+
+        start, end = events[index], events[index + 1]
+        if end.is_fade:
+            start_time = frames[index] * scale
+            return _mix_colors(
+                start.color,
+                end.color,
+                time - start_time,
+                frames[index + 1] * scale - start_time,
+            )
+        else:
+            return start.color
+
+    def _get_window(
+        self, by_frame: bool, limit
+    ) -> Tuple[List[ExecutorState], List[float], List[int]]:
+        """Returns the lists of events, timestamps and frames that a query of
+        a bounded log at the given timestamp or frame must use, extended
+        beyond the timestamp or frame.
+
+        Queries within the shared window of the log use the window. Earlier
+        queries use a private replay of the light program that the cursor
+        keeps until it returns to the shared window, so cursors looking at
+        different parts of the light program do not move the window back
+        and forth for each other.
+        """
+        window = self._log.get_window(by_frame, limit)
+        if window is None:
+            replay = self._replay
+            if replay is not None:
+                window = replay.get_window(by_frame, limit)
+            if window is None:
+                replay = self._replay = self._log.replay(2 if by_frame else 1, limit)
+                window = replay.get_window(by_frame, limit)
+                assert window is not None
+        else:
+            self._replay = None
+
+        # The index of the previous query is meaningless in other lists
+        if window[0] is not self._window[0]:
+            self._index = 0
+        self._window = window
+        return window
+
+    def _record(self, timestamp: float, index: int, elapsed: float) -> None:
+        """Records the metrics of a query that moved the cursor from the
+        given index to its current index.
+        """
+        _QUERIES.inc()
+        if timestamp < self._last_query:
+            _REWINDS.inc()
+        self._last_query = timestamp
+
+        distance = abs(self._index - index)
+        if distance:
+            _CURSOR_MISSES.inc()
+            _SEEK_DISTANCE.observe(distance)
+        else:
+            _CURSOR_HITS.inc()
+
+        _QUERY_LATENCY.observe(elapsed)
+
 
 class Player:
     """Object that takes a LedCtrl light program in its abstract syntax tree
     format and can then answer queries about the color of the light program at
     any point in time, or iterate over the light program with a fixed number of
     frames per second.
+
+    Queries made directly on the player go through a default cursor. Use
+    ``cursor()`` to create additional cursors when multiple consumers need to
+    look at different parts of the same light program.
     """
 
     @classmethod
     def from_bytes(
-        cls, data: bytes, format: InputFormatLike = InputFormat.LEDCTRL_BINARY
+        cls,
+        data: Buffer,
+        format: InputFormatLike = InputFormat.LEDCTRL_BINARY,
+        *,
+        max_events: Optional[int] = None,
     ):
         """Creates a bytecode player object that will play the given light
         program.
 
         Parameters:
-            data: the light program to play
+            data: the light program to play; any bytes-like object (bytes,
+                bytearray, memoryview or mmap). Compiled bytecode is parsed
+                without copying the buffer, so slices of a large archive can
+                be played directly.
             format: the format of the input
+            max_events: the retention bound of the events of the player; see
+                the constructor for more details
         """
         ast = compile(data, input_format=format, output_format="ast")
-        return cls(ast=ast)
+        return cls(ast=ast, max_events=max_events)
 
     @classmethod
-    def from_file(cls, filename: str, format: Optional[InputFormatLike] = None):
+    def from_file(
+        cls,
+        filename: str,
+        format: Optional[InputFormatLike] = None,
+        *,
+        max_events: Optional[int] = None,
+    ):
         """Creates a bytecode player object that will play the bytecode found
         in the given file.
 
@@ -48,72 +773,153 @@ class Player:
             filename: name of the file to load
             format: the format of the input; `None` means autodetection from the
                 extension of the file
+            max_events: the retention bound of the events of the player; see
+                the constructor for more details
         """
-        return cls(ast=compile(filename, input_format=format, output_format="ast"))
+        ast = compile(filename, input_format=format, output_format="ast")
+        return cls(ast=ast, max_events=max_events)
 
     @classmethod
-    def from_json(cls, data: dict, format: InputFormatLike = InputFormat.LEDCTRL_JSON):
+    def from_json(
+        cls,
+        data: dict,
+        format: InputFormatLike = InputFormat.LEDCTRL_JSON,
+        *,
+        max_events: Optional[int] = None,
+    ):
         """Creates a bytecode player object that will play the given light
         program in JSON format.
 
         Parameters:
             data: the light program to play
             format: the format of the input
+            max_events: the retention bound of the events of the player; see
+                the constructor for more details
         """
         ast = compile(data, input_format=format, output_format="ast")
-        return cls(ast=ast)
+        return cls(ast=ast, max_events=max_events)
 
-    def __init__(self, ast=None):
+    def __init__(self, ast=None, *, max_events: Optional[int] = None):
         """Constructor.
 
         Parameters:
             ast: the abstract syntax tree of the light program to play
+            max_events: the retention bound of the events of the player.
+                ``None`` means that the player keeps all the events of the
+                light program up to the latest timestamp that was queried,
+                which takes about 230 bytes per event and grows without
+                bound for light programs with infinite loops. Otherwise, the
+                player keeps at most twice this many events and a small
+                checkpoint after every ``max_events`` events; queries before
+                the retained events re-execute the light program from the
+                nearest checkpoint, separately for each cursor.
         """
         self._ast = ast
-        self._rewind()
+        self._log = _EventLog(ast, max_events=max_events)
+        self._cursor = self.cursor()
+        self._is_infinite: Optional[bool] = None
 
     @property
     def ended(self) -> bool:
-        """Returns whether the current light sequence has ended."""
-        return self._event_iter is None
+        """Returns whether the last query of the player was at or after the
+        end of the light program.
+        """
+        return self._cursor.ended
+
+    @property
+    def is_infinite(self) -> bool:
+        """Returns whether the light program never ends because it contains
+        an infinite loop. The flattened timeline of such a light program must
+        be limited explicitly; see ``timeline()``.
+        """
+        if self._is_infinite is None:
+            ast = self._ast
+            self._is_infinite = (
+                ast is not None and _get_outcome(ast.statements) == _RUNS_FOREVER
+            )
+        return self._is_infinite
+
+    def cursor(self) -> PlayerCursor:
+        """Creates a new, independent cursor that can answer queries about
+        the light program of this player.
+
+        Use separate cursors for separate consumers of the light program
+        (e.g., separate views of a user interface, or separate threads) so
+        they do not interfere with each other. Cursors share the events of
+        the light program with the player so creating a cursor is cheap.
+
+        Queries of the cursor are reported to ``pyledctrl.metrics.registry``
+        while the registry is enabled.
+        """
+        return PlayerCursor(self._log)
 
     def get_color_at(self, timestamp: float) -> Color:
         """Returns the color that the light program emits at the given
         timestamp.
         """
-        if not isfinite(timestamp):
-            raise ValueError("infinite timestamp not supported")
+        return self._cursor.get_color_at(timestamp)
 
-        # Do we need to rewind?
-        if self._events and timestamp < self._events[0].timestamp:
-            self._rewind()
+    def get_color_at_frame(self, frame: int, fps: Optional[Rate] = None) -> Color:
+        """Returns the color that the light program emits at the given frame,
+        using integer arithmetic only.
 
-        # Fast-forward to the given timestamp and feed the event queue
-        while timestamp >= self._last_event_time:
-            self._get_next_event()
+        Parameters:
+            frame: the index of the frame
+            fps: the frame rate that the frame index refers to, in frames per
+                second; ``None`` means ``Duration.FPS``, the frame rate of
+                the light program itself. Any rational number is accepted.
+        """
+        return self._cursor.get_color_at_frame(frame, fps)
 
-        # At this point, we can be sure that the event queue has at least two
-        # items (we put the _START element in there first, and in the worst
-        # case we have exhausted the light program immediately, also placing
-        # _END in the queue)
+    def iterate_frames(self, fps: Optional[Rate] = None) -> Iterator[Tuple[int, Color]]:
+        """Iterates over the light program with the given frame rate and
+        produces an iterable of pairs consisting of a frame index and the
+        corresponding RGB color, using integer arithmetic only.
 
-        # Optimize for the common case: timestamp is almost always somewhere
-        # between the last two items in the event queue, so scan from the
-        # back
-        ev = self._events
-        index = len(ev) - 2
-        while index > 0 and timestamp < ev[index].timestamp:
-            index -= 1
+        Parameters:
+            fps: the number of frames per second to generate; ``None`` means
+                ``Duration.FPS``, the frame rate of the light program itself.
+                Any rational number is accepted.
 
-        start, end = ev[index], ev[index + 1]
-        if end.is_fade:
-            diff = end.timestamp - start.timestamp
-            ratio = (timestamp - start.timestamp) / diff
-            color = start.color.mix_with(end.color, ratio=ratio, integral=True)
-        else:
-            color = start.color
+        Yields:
+            a frame index-color pair for each frame
+        """
+        rates = [Duration.FPS if fps is None else fps]
+        for _, frame, color in self.iterate_frames_at_rates(rates):
+            yield frame, color
 
-        return color
+    def iterate_frames_at_rates(
+        self, rates: Iterable[Rate]
+    ) -> Iterator[Tuple[int, int, Color]]:
+        """Iterates over the light program with multiple frame rates at the
+        same time, in a single sweep over the events of the light program.
+
+        Frames are produced in chronological order; frames of different rates
+        that fall on the same time instant are ordered by the index of their
+        rates. The iteration of each rate stops after the first frame at or
+        after the end of the light program, like ``iterate_frames()`` does.
+
+        Parameters:
+            rates: the frame rates to generate, in frames per second. Any
+                rational number is accepted.
+
+        Yields:
+            triplets consisting of the index of the frame rate in the input,
+            the index of the frame and the corresponding RGB color
+        """
+        periods, scale = _get_frame_periods(rates)
+        cursor = self._cursor = self.cursor()
+
+        # Heap items are (time, rate index, frame index) triplets where the
+        # time is expressed in units of 1/scale frames of the light program
+        queue = [(0, index, 0) for index in range(len(periods))]
+        heapify(queue)
+
+        while queue:
+            time, index, frame = heappop(queue)
+            yield index, frame, cursor._get_color_at_scaled_time(time, scale)
+            if not cursor.ended:
+                heappush(queue, (time + periods[index], index, frame + 1))
 
     def iterate(self, fps: int = 25) -> Iterator[Tuple[float, Color]]:
         """Iterates over the light program and produces an iterable of pairs
@@ -122,39 +928,197 @@ class Player:
         Parameters:
             fps: the number of frames per second to generate
 
-        Yields:
-            a timestamp-color pair for each frame
+        Returns:
+            an iterator yielding a timestamp-color pair for each frame
         """
-        self._rewind()
+        if _registry.enabled:
+            return self._iterate_queries(fps)
+        else:
+            return chain.from_iterable(self._iterate_segments(fps))
 
-        seconds, frames, t, dt = 0, 0, 0, 1.0 / fps
+    def _iterate_queries(self, fps: int) -> Iterator[Tuple[float, Color]]:
+        """Implementation of ``iterate()`` that queries a cursor for each
+        frame so the queries are reported to the metrics registry. Produces
+        the same output as ``_iterate_segments()``, only slower.
+        """
+        cursor = self._cursor = self.cursor()
+        dt = 1.0 / fps
+        for seconds in count():
+            for t in accumulate(chain((seconds,), repeat(dt, fps - 1))):
+                yield t, cursor.get_color_at(t)
+                if cursor.ended:
+                    return
+
+    def _iterate_segments(self, fps: int) -> Iterator[Iterable[Tuple[float, Color]]]:
+        """Walks the segments between consecutive events of the light program
+        and yields iterables of timestamp-color pairs for the frames of
+        ``iterate()``, one iterable per segment and second.
+
+        Frames are strictly monotonic so the segments can be walked with a
+        single index instead of querying the cursor for each frame, and the
+        frames of each segment are produced by iterators that need no Python
+        code to run per frame. Timestamps and colors are calculated with
+        exactly the same floating-point operations as ``get_color_at()`` so
+        the output is identical: timestamps are accumulated from the start
+        of each second and fade colors are mixed with float ratios.
+        """
+        cursor = self._cursor = self.cursor()
+        log = self._log
+        if log.max_events is not None:
+            # Walk a private replay so the iteration does not move the window
+            # of the bounded log for the other cursors
+            log = log.replay(0, 0)
+        log.extend_beyond(0)
+        events, timestamps = log.events, log.timestamps
+        generation = log.generation
 
-        while not self.ended:
-            yield t, self.get_color_at(t)
-            t += dt
-            frames += 1
-            if frames == fps:
-                seconds, frames = seconds + 1, 0
-                t = seconds
+        dt = 1.0 / fps
+        index = 0
+        make_color = partial(tuple.__new__, Color)
+
+        for seconds in count():
+            times = list(accumulate(chain((seconds,), repeat(dt, fps - 1))))
+            pos = 0
+            while pos < fps:
+                t = times[pos]
+                if timestamps[-1] <= t:
+                    log.extend_beyond(t)
+                    if generation != log.generation:
+                        # The window of a bounded log has moved
+                        generation = log.generation
+                        events, timestamps = log.events, log.timestamps
+                        index = max(bisect_right(timestamps, t) - 1, 0)
+                while timestamps[index + 1] <= t:
+                    index += 1
+
+                start, end = events[index], events[index + 1]
+                end_time = timestamps[index + 1]
+                cursor._index = index
+
+                if log.complete and t >= timestamps[-2]:
+                    cursor._ended = True
+                    yield ((t, start.color),)
+                    return
+
+                stop = bisect_left(times, end_time, pos)
+                if end.is_fade:
+                    # Same formula as Color.mix_with(); the special cases for
+                    # ratios outside (0, 1) yield the same values anyway
+                    fade_times = times[pos:stop]
+                    start_time = start.timestamp
+                    diff = end_time - start_time
+                    ratios = [(t - start_time) / diff for t in fade_times]
+                    rests = [1 - ratio for ratio in ratios]
+                    channels = [
+                        # Mixing a value with itself always rounds back to
+                        # the same value
+                        (
+                            [x] * len(ratios)
+                            if x == y
+                            else [round(x * a + y * b) for a, b in zip(rests, ratios)]
+                        )
+                        for x, y in zip(start.color, end.color)
+                    ]
+                    yield zip(fade_times, map(make_color, zip(*channels)))
+                else:
+                    # Constant stretch; no need to calculate anything
+                    yield zip(islice(times, pos, stop), repeat(start.color))
+
+                pos = stop
+
+    def timeline(self, until: Optional[int] = None) -> Iterator[Segment]:
+        """Iterates over the flattened timeline of the light program, i.e. the
+        segments between consecutive events of the light program, in the
+        order of their start frames.
+
+        Segments of zero length are skipped; the timeline ends with the last
+        event of the light program. The timeline of a restored player starts
+        with the events in the snapshot that it was restored from.
+
+        Parameters:
+            until: the frame at ``Duration.FPS`` frames per second where the
+                timeline should stop; segments that start at or after this
+                frame are omitted, but the last segment may extend beyond
+                it. ``None`` means to stop at the end of the light program.
+
+        Raises:
+            ValueError: if the light program never ends and no limit was
+                given
+        """
+        if until is None and self.is_infinite:
+            raise ValueError("light program never ends; the timeline must be limited")
+        return self._iterate_timeline(until)
+
+    def _iterate_timeline(self, until: Optional[int]) -> Iterator[Segment]:
+        root = log = self._log
+        if root.max_events is not None:
+            # Walk a private replay so the iteration does not move the window
+            # of the bounded log for the other cursors
+            log = root.replay(0, 0)
+
+        # Position of the event that starts the next segment in the light
+        # program; the window of a bounded log may move during the iteration
+        position = 0 if root.restored else 1
+
+        while True:
+            index = position - log.position
+            if index < 0:
+                log = root.replay(0, position)
+                continue
+
+            events, frames = log.events, log.frames
+            if index + 1 >= len(events):
+                if log.complete:
+                    return
+                log.extend_beyond_frame(frames[-1])
+                continue
+
+            start, end = events[index], events[index + 1]
+            if end is _END:
+                return
+
+            start_frame, end_frame = frames[index], frames[index + 1]
+            if until is not None and start_frame >= until:
+                return
+
+            if start_frame < end_frame:
+                is_fade = bool(end.is_fade)
+                yield Segment(
+                    start=start_frame,
+                    end=end_frame,
+                    start_color=start.color,
+                    end_color=end.color if is_fade else start.color,
+                    is_fade=is_fade,
+                )
+
+            position += 1
+
+    def snapshot(self) -> PlayerSnapshot:
+        """Returns a compact snapshot of the playback position of the player.
+
+        The snapshot may be passed to ``restore()`` later, on a player of the
+        same light program, to resume the playback without executing the light
+        program from the start. The restored player can answer queries for
+        timestamps that are not earlier than the latest timestamp queried
+        before the snapshot was taken.
+        """
+        return self._log.snapshot()
+
+    def restore(self, snapshot: PlayerSnapshot) -> None:
+        """Restores the playback position of the player from a snapshot that
+        was created by ``snapshot()`` on a player of the same light program.
+
+        Restoring a snapshot takes time proportional to the nesting depth of
+        the loops in the light program only. Cursors created before the
+        restoration keep on working with the old state of the player.
+
+        Raises:
+            ValueError: if the snapshot does not belong to the light program
+                of the player
+        """
+        self._log = _EventLog(self._ast, snapshot, self._log.max_events)
+        self._cursor = self.cursor()
 
     def to_bytes(self) -> bytes:
         """Returns the light program encoded in LedCtrl format."""
         return self._ast.to_bytecode()
-
-    def _get_next_event(self) -> None:
-        """Retrieves the next event from the executor and stores it in the
-        event queue.
-        """
-        if not self.ended:
-            event = next(self._event_iter, _END)
-            event.timestamp = float(event.timestamp)
-            self._events.append(event)
-            if event is _END:
-                self._event_iter = None
-            self._last_event_time = event.timestamp
-
-    def _rewind(self) -> None:
-        """Rewinds the execution of the bytecode to zero time."""
-        self._events = deque([_START], maxlen=32)
-        self._last_event_time = -1
-        self._event_iter = Executor().execute(self._ast) if self._ast else iter([])
@@ -0,0 +1,240 @@
+"""Player for the light programs of a large number of drones that trades
+accuracy for speed when the colors of all the drones are needed at the same
+time, e.g., when a large swarm is shown in a zoomed-out view.
+"""
+
+from heapq import heapify, heappop, heappush
+from math import inf
+from time import perf_counter
+from typing import Iterable, List, NamedTuple, Optional, Sequence, Tuple
+
+from .executor import Color
+from .metrics import registry as _registry
+from .player import Player, PlayerCursor
+
+__all__ = ("SwarmFrame", "SwarmPlayer")
+
+
+_FRAME_TIME = _registry.histogram(
+    "pyledctrl_swarm_frame_seconds", "Time needed to sample the colors of a swarm"
+)
+_REFRESHED = _registry.counter(
+    "pyledctrl_swarm_refreshed_total",
+    "Number of drone colors that were re-evaluated by swarm samples",
+)
+_REUSED = _registry.counter(
+    "pyledctrl_swarm_reused_total",
+    "Number of drone colors that were reused from earlier swarm samples",
+)
+
+
+class SwarmFrame(NamedTuple):
+    """The result of sampling the colors of a swarm at a given time
+    instant.
+    """
+
+    colors: List[Color]
+    """The colors of the drones in the swarm. This list is owned by the
+    swarm player and it is updated in place by subsequent samples; make a
+    copy if you need to keep it.
+    """
+
+    refreshed: List[int]
+    """The indices of the drones whose colors were re-evaluated for this
+    sample, in increasing order. The colors of all the other drones were
+    reused from earlier samples.
+    """
+
+
+class SwarmPlayer:
+    """Player that samples the colors of the light programs of a swarm of
+    drones at the same time instants, with a configurable error budget.
+
+    The player remembers the color of each drone from the last time it was
+    evaluated and the time until which that color is known to stay within
+    the error budget, based on the segment of the light program that the
+    drone is in. Drones whose colors are still within the budget are not
+    evaluated again, so the cost of a sample is proportional to the number
+    of drones whose colors are refreshed, not to the size of the swarm.
+
+    Each drone may also have a level of detail between zero and one that
+    scales the error budget of the drone; drones that are far away or small
+    on the screen can be given a lower level of detail so they are refreshed
+    less frequently. Drones with zero detail are refreshed only when their
+    light program moves to a new segment.
+
+    Drones may share the same player; each drone gets its own cursor on the
+    light program of the player. Each drone may also have its own time base:
+    a start offset and a playback rate that map the timestamps of the swarm
+    to the timestamps of the light program of the drone. This allows
+    staggered formations (e.g., a wave across the swarm) to be played from a
+    single light program instead of compiling a separate light program for
+    each drone.
+    """
+
+    def __init__(
+        self,
+        players: Iterable[Player],
+        offsets: Optional[Sequence[float]] = None,
+        rates: Optional[Sequence[float]] = None,
+    ):
+        """Constructor.
+
+        Parameters:
+            players: the players of the light programs of the drones. The
+                same player may appear multiple times.
+            offsets: the start offsets of the drones, in seconds; the light
+                program of a drone starts when the timestamp of the swarm
+                reaches the offset of the drone. Drones are black before
+                their light programs start. ``None`` means zero offsets.
+            rates: the playback rates of the drones; a drone with rate 2
+                plays its light program at twice the normal speed. ``None``
+                means normal speed for all the drones.
+
+        Raises:
+            ValueError: if the number of offsets or rates does not match the
+                number of drones or some of the rates are not positive
+        """
+        self._cursors: List[PlayerCursor] = [player.cursor() for player in players]
+        self._colors: List[Color] = [Color.BLACK] * len(self._cursors)
+        self._detail: Optional[List[float]] = None
+        self._offsets: Optional[List[float]] = None
+        self._rates: Optional[List[float]] = None
+        if offsets is not None or rates is not None:
+            self._set_time_bases(offsets, rates)
+        self._last_timestamp = -inf
+        self._last_tolerance = 0.0
+        self._queue: List[Tuple[float, int]] = []
+        self.invalidate()
+
+    def __len__(self) -> int:
+        return len(self._cursors)
+
+    @property
+    def offsets(self) -> Optional[List[float]]:
+        """The start offsets of the drones in seconds, or ``None`` if the
+        drones have no time bases of their own.
+        """
+        return self._offsets
+
+    @property
+    def rates(self) -> Optional[List[float]]:
+        """The playback rates of the drones, or ``None`` if the drones have
+        no time bases of their own.
+        """
+        return self._rates
+
+    @property
+    def detail(self) -> Optional[List[float]]:
+        """The levels of detail of the drones, or ``None`` if all the drones
+        are shown in full detail.
+        """
+        return self._detail
+
+    @detail.setter
+    def detail(self, value: Optional[Sequence[float]]) -> None:
+        if value is not None:
+            value = [float(x) for x in value]
+            if len(value) != len(self._cursors):
+                raise ValueError("detail must be given for each drone")
+            if any(not 0 <= x <= 1 for x in value):
+                raise ValueError("levels of detail must be between 0 and 1")
+        self._detail = value
+        self.invalidate()
+
+    def _set_time_bases(
+        self, offsets: Optional[Sequence[float]], rates: Optional[Sequence[float]]
+    ) -> None:
+        num_drones = len(self._cursors)
+        offsets = [0.0] * num_drones if offsets is None else [float(x) for x in offsets]
+        rates = [1.0] * num_drones if rates is None else [float(x) for x in rates]
+        if len(offsets) != num_drones:
+            raise ValueError("offset must be given for each drone")
+        if len(rates) != num_drones:
+            raise ValueError("rate must be given for each drone")
+        if any(not 0 < x < inf for x in rates):
+            raise ValueError("rates must be positive")
+        self._offsets, self._rates = offsets, rates
+
+    def invalidate(self) -> None:
+        """Forces the next sample to refresh the colors of all the drones."""
+        self._queue = [(-inf, index) for index in range(len(self._cursors))]
+
+    def sample(self, timestamp: float, tolerance: float = 0) -> SwarmFrame:
+        """Returns the colors of all the drones at the given timestamp.
+
+        Parameters:
+            timestamp: the timestamp to sample
+            tolerance: the error budget; the largest difference in any of
+                the color channels between the returned color of a drone in
+                full detail and its exact color. Zero means that the returned
+                colors are exact.
+
+        Returns:
+            the colors of the drones and the indices of the drones whose
+            colors were refreshed
+        """
+        if _registry.enabled:
+            started_at = perf_counter()
+            frame = self._sample(timestamp, tolerance)
+            _FRAME_TIME.observe(perf_counter() - started_at)
+            _REFRESHED.inc(len(frame.refreshed))
+            _REUSED.inc(len(self._cursors) - len(frame.refreshed))
+            return frame
+        else:
+            return self._sample(timestamp, tolerance)
+
+    def _sample(self, timestamp: float, tolerance: float) -> SwarmFrame:
+        if timestamp < self._last_timestamp or tolerance != self._last_tolerance:
+            # Expiry times are valid only for forward playback with the same
+            # error budget
+            self.invalidate()
+
+        self._last_timestamp = timestamp
+        self._last_tolerance = tolerance
+
+        queue, cursors, colors, detail, offsets, rates = (
+            self._queue,
+            self._cursors,
+            self._colors,
+            self._detail,
+            self._offsets,
+            self._rates,
+        )
+
+        refreshed = []
+        while queue and queue[0][0] <= timestamp:
+            refreshed.append(heappop(queue)[1])
+        refreshed.sort()
+
+        items = []
+        for index in refreshed:
+            if detail is None:
+                drone_tolerance = tolerance
+            else:
+                level = detail[index]
+                drone_tolerance = tolerance / level if level > 0 else inf
+
+            if offsets is None:
+                color, expiry = cursors[index].get_color_and_expiry_at(
+                    timestamp, drone_tolerance
+                )
+            else:
+                # Expiry times are in the time base of the drone; map them
+                # back to the time base of the swarm
+                offset, rate = offsets[index], rates[index]  # type: ignore
+                color, expiry = cursors[index].get_color_and_expiry_at(
+                    (timestamp - offset) * rate, drone_tolerance
+                )
+                expiry = offset + expiry / rate
+            colors[index] = color
+            items.append((expiry, index))
+
+        if queue:
+            for item in items:
+                heappush(queue, item)
+        else:
+            queue[:] = items
+            heapify(queue)
+
+        return SwarmFrame(colors=colors, refreshed=refreshed)
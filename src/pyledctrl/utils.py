@@ -1,9 +1,13 @@
 """Utility functions for PyLedCtrl."""
 
+import os
 import sys
+import threading
 
 from itertools import tee
-from typing import cast, Callable, Iterable, List, Tuple, TypeVar, overload
+from typing import cast, Callable, Iterable, Tuple, TypeVar, overload
+
+from .varuint import encode_varuint
 
 
 T = TypeVar("T")
@@ -143,7 +147,6 @@ def parse_as_frame_count(value: str, *, fps: int) -> int:
     return int((minutes * 60 + seconds) * fps + residual)
 
 
-@memoize
 def to_varuint(value: int) -> bytes:
     """Converts the given numeric value into its varuint representation.
 
@@ -153,18 +156,32 @@ def to_varuint(value: int) -> bytes:
     Returns:
         the variable-length uint representation of the input value
     """
-    if value < 0:
-        raise ValueError("negative varuints are not supported")
-    elif value < 128:
-        return bytes([value])
-    else:
-        result: List[int] = []
-        while True:
-            if value < 128:
-                result.append(value)
-                break
+    return encode_varuint(value)
+
+
+def write_file_atomically(filename: str, data: bytes) -> None:
+    """Writes the given data into a file atomically; readers of the file will
+    see either the old or the new contents of the file but never a partially
+    written file.
 
-            result.append((value & 0x7F) + 0x80)
-            value >>= 7
+    The data is written into a temporary file in the same directory first, and
+    then the temporary file is renamed to the final name.
 
-        return bytes(result)
+    Parameters:
+        filename: the name of the file to write
+        data: the data to write
+    """
+    filename = os.fspath(filename)
+    temp_filename = "{0}.{1}-{2}.tmp".format(
+        filename, os.getpid(), threading.get_ident()
+    )
+    try:
+        with open(temp_filename, "wb") as fp:
+            fp.write(data)
+        os.replace(temp_filename, filename)
+    except BaseException:
+        try:
+            os.unlink(temp_filename)
+        except OSError:
+            pass
+        raise
@@ -0,0 +1,204 @@
+"""Encoder and decoder for the variable-length unsigned integers (varuints)
+used in the LedCtrl bytecode.
+
+A varuint is stored in little-endian groups of seven bits; the most
+significant bit of each byte is set if more bytes follow. Values below 128
+are therefore stored in a single byte and values below 16384 in two bytes.
+
+The encoder uses a precomputed table for single-byte values and a fast path
+for two-byte values; nothing else is cached, so the memory usage of the
+codec does not grow with the number of distinct values it has seen.
+"""
+
+from typing import IO, Iterable, List, Optional, Tuple, Union
+
+__all__ = (
+    "decode_varuint",
+    "decode_varuints",
+    "encode_varuint",
+    "encode_varuint_into",
+    "encode_varuints",
+    "read_varuint",
+    "varuint_length",
+)
+
+
+Buffer = Union[bytes, bytearray, memoryview]
+"""Type alias for the buffer types that the decoder accepts."""
+
+
+_SINGLE_BYTES: Tuple[bytes, ...] = tuple(bytes([value]) for value in range(128))
+"""Encoded representations of all the single-byte varuints."""
+
+
+def varuint_length(value: int) -> int:
+    """Returns the number of bytes needed to encode the given non-negative
+    integer as a varuint.
+    """
+    if value < 0x80:
+        return 1
+    elif value < 0x4000:
+        return 2
+    elif value < 0x200000:
+        return 3
+    else:
+        return (value.bit_length() + 6) // 7
+
+
+def encode_varuint(value: int) -> bytes:
+    """Encodes the given non-negative integer as a varuint.
+
+    Raises:
+        ValueError: if the value is negative
+    """
+    if value < 0x80:
+        if value < 0:
+            raise ValueError("negative varuints are not supported")
+        return _SINGLE_BYTES[value]
+    elif value < 0x4000:
+        return bytes(((value & 0x7F) | 0x80, value >> 7))
+    else:
+        result = bytearray()
+        encode_varuint_into(result, value)
+        return bytes(result)
+
+
+def encode_varuint_into(output: bytearray, value: int) -> None:
+    """Appends the varuint representation of the given non-negative integer
+    to the given byte array.
+
+    Raises:
+        ValueError: if the value is negative
+    """
+    if value < 0:
+        raise ValueError("negative varuints are not supported")
+    while value >= 0x80:
+        output.append((value & 0x7F) | 0x80)
+        value >>= 7
+    output.append(value)
+
+
+def encode_varuints(values: Iterable[int]) -> bytes:
+    """Encodes the given sequence of non-negative integers as consecutive
+    varuints.
+
+    Raises:
+        ValueError: if any of the values is negative
+    """
+    output = bytearray()
+    append = output.append
+    for value in values:
+        if 0 <= value < 0x80:
+            append(value)
+        else:
+            encode_varuint_into(output, value)
+    return bytes(output)
+
+
+def decode_varuint(data: Buffer, pos: int = 0) -> Tuple[int, int]:
+    """Decodes a single varuint from the given buffer.
+
+    Parameters:
+        data: the buffer to decode the varuint from
+        pos: the index of the first byte of the varuint in the buffer
+
+    Returns:
+        the decoded value and the index of the first byte after the varuint
+
+    Raises:
+        EOFError: if the buffer ends before the end of the varuint
+    """
+    try:
+        byte = data[pos]
+        if byte < 0x80:
+            return byte, pos + 1
+
+        value, shift = byte & 0x7F, 7
+        while True:
+            pos += 1
+            byte = data[pos]
+            value |= (byte & 0x7F) << shift
+            if byte < 0x80:
+                return value, pos + 1
+            shift += 7
+    except IndexError:
+        raise EOFError("unexpected end of data while decoding varuint") from None
+
+
+def decode_varuints(
+    data: Buffer, pos: int = 0, count: Optional[int] = None
+) -> Tuple[List[int], int]:
+    """Decodes consecutive varuints from the given buffer.
+
+    Parameters:
+        data: the buffer to decode the varuints from
+        pos: the index of the first byte of the first varuint in the buffer
+        count: the number of varuints to decode; ``None`` means to decode
+            varuints until the end of the buffer
+
+    Returns:
+        the decoded values and the index of the first byte after the last
+        decoded varuint
+
+    Raises:
+        EOFError: if the buffer ends before the end of the last varuint
+    """
+    result: List[int] = []
+    append = result.append
+    end = len(data)
+
+    while count is None or len(result) < count:
+        if pos >= end:
+            if count is None:
+                break
+            raise EOFError("unexpected end of data while decoding varuint")
+
+        byte = data[pos]
+        if byte < 0x80:
+            append(byte)
+            pos += 1
+        else:
+            value, pos = decode_varuint(data, pos)
+            append(value)
+
+    return result, pos
+
+
+def read_varuint(fp: IO[bytes]) -> int:
+    """Reads a single varuint from the given binary stream.
+
+    When the stream supports peeking into its buffer (like
+    ``io.BufferedReader``), the varuint is decoded directly from the buffer
+    and consumed with a single read.
+
+    Raises:
+        EOFError: if the stream ends before the end of the varuint
+    """
+    peek = getattr(fp, "peek", None)
+    if peek is not None:
+        chunk = peek(1)
+        if chunk:
+            byte = chunk[0]
+            if byte < 0x80:
+                fp.read(1)
+                return byte
+            try:
+                value, length = decode_varuint(chunk)
+            except EOFError:
+                # Varuint is split across buffer boundaries; fall back to
+                # reading it byte by byte
+                pass
+            else:
+                fp.read(length)
+                return value
+
+    value, shift = 0, 0
+    while True:
+        byte = fp.read(1)
+        if not byte:
+            raise EOFError("unexpected end of stream while reading varuint")
+        x = byte[0]
+        value |= (x & 0x7F) << shift
+        if x < 0x80:
+            return value
+        shift += 7
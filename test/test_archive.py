@@ -0,0 +1,94 @@
+from fractions import Fraction
+from pathlib import Path
+
+from pyledctrl.archive import DroneTrack, InvalidArchiveError, ShowArchive
+from pyledctrl.player import Player
+
+import pytest
+
+
+@pytest.fixture
+def show() -> bytes:
+    return (
+        Path(__file__).parent / "data" / "executor" / "show_file_1.bin"
+    ).read_bytes()
+
+
+class TestShowArchive:
+    def test_shared_programs(self, show):
+        archive = ShowArchive()
+        for index in range(1000):
+            assert archive.add_drone(show, offset=index) == index
+
+        assert len(archive) == 1000
+        assert len(archive.programs) == 1
+        assert archive.drones[999] == DroneTrack(program=0, offset=999)
+
+        data = archive.to_bytes()
+        assert len(data) < len(show) + 3 * 1000 + 16
+
+        restored = ShowArchive.from_bytes(data)
+        assert restored.drones == archive.drones
+        assert [bytes(program) for program in restored.programs] == [show]
+
+        # Restored archives deduplicate light programs too
+        assert restored.add_drone(show, offset=-25) == 1000
+        assert len(restored.programs) == 1
+        assert ShowArchive.from_bytes(restored.to_bytes()).drones[-1].offset == -25
+
+    def test_rates_and_swarm_playback(self, show):
+        archive = ShowArchive()
+        archive.add_drone(show)
+        archive.add_drone(show, offset=100, rate=Fraction(1, 2))
+        archive.add_drone(b"", rate="1.5")
+
+        restored = ShowArchive.from_bytes(bytearray(archive.to_bytes()))
+        assert [drone.rate for drone in restored.drones] == [1, 0.5, 1.5]
+        assert restored.drones[1].offset_in_seconds == 2
+
+        swarm = restored.create_swarm_player()
+        reference = Player.from_bytes(show)
+        for timestamp in (0, 1, 2.5, 10, 60, 120):
+            colors, _ = swarm.sample(timestamp)
+            assert colors[0] == reference.get_color_at(timestamp)
+            assert colors[1] == reference.get_color_at((timestamp - 2) / 2)
+
+        with pytest.raises(ValueError):
+            archive.add_drone(show, rate=0)
+
+    def test_invalid_archives(self, show):
+        archive = ShowArchive()
+        archive.add_drone(show, offset=10)
+        data = archive.to_bytes()
+
+        for invalid in (b"", b"LCSB\x01\x00", b"LCSA\x02\x00", data[:-1], data + b"\0"):
+            with pytest.raises(InvalidArchiveError):
+                ShowArchive.from_bytes(invalid)
+
+    def test_phrase_dictionary(self, show):
+        data = Path(__file__).parent / "data" / "compiler"
+        pulses = [
+            (data / name).read_bytes()
+            for name in ("blue_pulse.bin", "green_pulse.bin", "red_pulse.bin")
+        ]
+
+        archive = ShowArchive()
+        for index in range(30):
+            # Programs differ but share the instructions of the pulses and
+            # the show
+            program = pulses[index % 3] + pulses[index // 3 % 3] + show
+            archive.add_drone(program, offset=index, rate=1 + index % 2)
+        archive.add_drone(b"")
+        archive.add_drone(b"\xff\xff")
+        assert len(archive.programs) == 11
+
+        plain = archive.to_bytes()
+        packed = archive.to_bytes(phrases=True)
+        assert len(packed) < len(plain) / 2
+
+        restored = ShowArchive.from_bytes(packed)
+        assert restored.drones == archive.drones
+        assert restored.programs == archive.programs
+
+        with pytest.raises(InvalidArchiveError):
+            ShowArchive.from_bytes(packed[:-1])
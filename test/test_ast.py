@@ -1,14 +1,23 @@
 import pytest
 
+from decimal import Decimal
+from io import StringIO
+from random import Random
+from warnings import catch_warnings, simplefilter
+
 from pyledctrl.compiler.ast import (
+    Comment,
     Duration,
     EndCommand,
+    LoopBlock,
     Node,
     NopCommand,
     SleepCommand,
+    StatementSequence,
+    UnsignedByte,
     WaitUntilCommand,
 )
-
+from pyledctrl.compiler.writer import LEDSourceWriter
 
 COMMANDS = [
     (EndCommand(), b"\x00", "end()"),
@@ -22,3 +31,83 @@ COMMANDS = [
 def test_simple_commands(input: Node, output: bytes, source: str):
     assert input.to_bytecode() == output
     assert input.to_led_source() == source
+
+
+def test_nested_loops_to_led_source():
+    inner = LoopBlock(
+        iterations=UnsignedByte(3),
+        body=StatementSequence([NopCommand(), Comment("foo"), EndCommand()]),
+    )
+    outer = LoopBlock(
+        iterations=UnsignedByte(2),
+        body=StatementSequence(
+            [SleepCommand(duration=Duration(25)), inner, LoopBlock(UnsignedByte(5))]
+        ),
+    )
+    program = StatementSequence([outer, NopCommand()])
+
+    expected = (
+        "with loop(iterations={0}):\n"
+        "    sleep(duration=0.5)\n"
+        "    with loop(iterations={1}):\n"
+        "        nop()\n"
+        "        \n"
+        "        " + "#" * 76 + "\n"
+        "        comment('foo')\n"
+        "        " + "#" * 76 + "\n"
+        "        \n"
+        "        end()\n"
+        "    \n"
+        "nop()"
+    ).format(outer.iterations, inner.iterations)
+    assert program.to_led_source() == expected
+
+    # Writing into a stream gives the same result
+    fp = StringIO()
+    writer = LEDSourceWriter(fp)
+    program.write_led_source(writer)
+    assert writer.has_output
+    writer.flush()
+    assert fp.getvalue() == expected
+
+    # Loops with a single iteration are not wrapped in a block
+    single = LoopBlock(UnsignedByte(1), StatementSequence([NopCommand(), NopCommand()]))
+    assert single.to_led_source() == "nop()\nnop()"
+
+
+def _convert_seconds(func, seconds):
+    with catch_warnings(record=True) as warnings:
+        simplefilter("always")
+        try:
+            result = func(seconds).value
+        except Exception as ex:
+            result = type(ex)
+    return result, len(warnings)
+
+
+def test_duration_from_seconds_matches_decimal_implementation():
+    rng = Random(87)
+    inputs = [0, 1, 7, 0.0, -0.0, 0.1, 0.2, 0.3, 0.1 + 0.2, 1e-5, 1e22, 0.01, -1]
+    inputs += [rng.randint(0, 100000) / 50 for _ in range(2000)]
+    inputs += [rng.randint(0, 100000) / 100 for _ in range(2000)]
+    inputs += [round(rng.uniform(0, 1000), rng.randint(0, 6)) for _ in range(2000)]
+    inputs += [rng.uniform(0, 1000) for _ in range(2000)]
+    inputs += [rng.randint(0, 3000) for _ in range(100)]
+    inputs += [float("inf"), float("nan")]
+
+    reference = Duration._from_seconds_with_decimals
+    for seconds in inputs:
+        # Evaluate twice to test the cache as well
+        expected = _convert_seconds(reference, seconds)
+        assert _convert_seconds(Duration.from_seconds, seconds) == expected, seconds
+        assert _convert_seconds(Duration.from_seconds, seconds) == expected, seconds
+
+
+def test_duration_from_seconds_with_different_frame_rate(monkeypatch):
+    assert Duration.from_seconds(0.5).value == 25
+
+    monkeypatch.setattr(Duration, "FPS", Decimal(30))
+    assert Duration.from_seconds(0.5).value == 15
+    assert Duration.from_seconds(0.1).value == 3
+    with pytest.warns(UserWarning):
+        assert Duration.from_seconds(1 / 30).value == 1
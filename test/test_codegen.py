@@ -0,0 +1,93 @@
+from pathlib import Path
+from random import Random
+
+from pyledctrl.codegen import clear_cache, compile_evaluator, generate_source
+from pyledctrl.player import Player
+
+import pytest
+
+
+@pytest.fixture
+def show() -> bytes:
+    return (
+        Path(__file__).parent / "data" / "executor" / "show_file_1.bin"
+    ).read_bytes()
+
+
+class TestCodegen:
+    def test_evaluator_matches_player(self, show):
+        evaluate = compile_evaluator(show)
+        player = Player.from_bytes(show)
+
+        rng = Random(42)
+        timestamps = [rng.uniform(-5, 170) for _ in range(5000)]
+        timestamps += [frame / 50 for frame in range(-10, 8200)]
+        for timestamp in timestamps:
+            assert evaluate(timestamp) == player.get_color_at(timestamp)
+
+        for timestamp in (float("inf"), float("-inf"), float("nan")):
+            with pytest.raises(ValueError):
+                evaluate(timestamp)
+
+    def test_empty_program(self):
+        evaluate = compile_evaluator(b"")
+        assert evaluate(-1) == evaluate(0) == evaluate(100) == (0, 0, 0)
+
+    def test_infinite_program(self):
+        from pyledctrl.compiler import BytecodeCompiler
+
+        source = (
+            b"set_color(0, 255, 0, duration=2)\n"
+            b"with loop(iterations=0):\n"
+            b"    set_color(255, 0, 0, duration=1)\n"
+        )
+        (bytecode,) = BytecodeCompiler().compile(
+            source, input_format="ledctrl_source", output_format="ledctrl_binary"
+        )
+        with pytest.raises(ValueError, match="never ends"):
+            compile_evaluator(bytecode)
+        with pytest.raises(ValueError, match="never ends"):
+            generate_source(Player.from_bytes(bytecode))
+
+        # Infinite loops after the end of the program do not matter
+        (bytecode,) = BytecodeCompiler().compile(
+            source.replace(b"with", b"end()\nwith"),
+            input_format="ledctrl_source",
+            output_format="ledctrl_binary",
+        )
+        assert compile_evaluator(bytecode)(100) == (0, 255, 0)
+
+        # Loops whose body always ends the program do not run forever
+        for source in (
+            b"with loop(iterations=0):\n"
+            b"    set_color(255, 0, 0, duration=1)\n"
+            b"    end()\n",
+            b"with loop(iterations=2):\n"
+            b"    set_color(255, 0, 0, duration=1)\n"
+            b"    end()\n"
+            b"with loop(iterations=0):\n"
+            b"    set_color(0, 0, 255, duration=1)\n",
+        ):
+            (bytecode,) = BytecodeCompiler(optimisation_level=0).compile(
+                source, input_format="ledctrl_source", output_format="ledctrl_binary"
+            )
+            player = Player.from_bytes(bytecode)
+            assert not player.is_infinite
+            assert list(player.timeline()) == []
+            assert compile_evaluator(bytecode)(100) == (255, 0, 0)
+
+    def test_cache(self, show):
+        clear_cache()
+        evaluate = compile_evaluator(show)
+        assert compile_evaluator(bytearray(show)) is evaluate
+        assert compile_evaluator(Player.from_bytes(show)) is evaluate
+
+        clear_cache()
+        assert compile_evaluator(show) is not evaluate
+
+    def test_generated_source(self, show):
+        source, namespace = generate_source(show, name="hero")
+        assert source.startswith("def hero(t):\n")
+        assert "if t < " in source
+        exec(source, namespace)
+        assert namespace["hero"](1.0) == Player.from_bytes(show).get_color_at(1.0)
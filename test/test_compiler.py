@@ -105,3 +105,502 @@ def test_iter_steps_in_plan():
     plan.insert_step(stage3, after=stage2)
 
     assert list(plan.iter_steps()) == [stage1, stage2, stage3]
+
+
+def test_compile_many():
+    data_dir = Path(__file__).parent / "data" / "compiler"
+    inputs = sorted(
+        path for path in data_dir.glob("*.led") if not path.name.startswith("_")
+    )
+    compiler = BytecodeCompiler(optimisation_level=2)
+
+    results = compiler.compile_many(inputs, output_format=OutputFormat.LEDCTRL_BINARY)
+    for path, result in zip(inputs, results):
+        assert result == (path.with_suffix(".bin").read_bytes(),)
+
+    received = []
+    compiler.compile_many(
+        [path.read_bytes() for path in inputs],
+        input_format="ledctrl_source",
+        output_format=OutputFormat.LEDCTRL_SOURCE,
+        callback=lambda input, result: received.append(result[0]),
+    )
+    assert received == [path.with_suffix(".oled").read_bytes() for path in inputs]
+
+
+def test_compile_from_buffers(tmp_path: Path):
+    from mmap import ACCESS_READ, mmap
+
+    data_dir = Path(__file__).parent / "data" / "compiler"
+    inputs = sorted(data_dir.glob("*.bin"))
+    expected = [path.read_bytes() for path in inputs]
+
+    # Slices of a large archive are compiled without copying them first
+    archive = bytearray(b"header")
+    offsets = []
+    for data in expected:
+        offsets.append((len(archive), len(archive) + len(data)))
+        archive += data
+    (tmp_path / "archive").write_bytes(archive)
+
+    compiler = BytecodeCompiler()
+    with (tmp_path / "archive").open("rb") as fp:
+        with mmap(fp.fileno(), 0, access=ACCESS_READ) as buffer:
+            view = memoryview(buffer)
+            for (start, end), data in zip(offsets, expected):
+                result = compiler.compile(
+                    view[start:end],
+                    input_format="ledctrl_binary",
+                    output_format="ledctrl_binary",
+                )
+                assert result == (data,)
+            view.release()
+
+    result = compiler.compile(
+        bytearray(expected[0]),
+        input_format="ledctrl_binary",
+        output_format="ledctrl_binary",
+    )
+    assert result == (expected[0],)
+
+    # Input files may also be mapped into memory instead of reading them
+    compiler = BytecodeCompiler(map_files=True)
+    for path, data in zip(inputs, expected):
+        assert compiler.compile(path, output_format="ledctrl_binary") == (data,)
+        json_path = path.with_suffix(".json")
+        assert compiler.compile(json_path, output_format="ledctrl_binary") == (data,)
+
+
+def test_compile_json_stream(tmp_path: Path):
+    data_dir = Path(__file__).parent / "data" / "compiler"
+    inputs = sorted(
+        path for path in data_dir.glob("*.led") if not path.name.startswith("_")
+    )
+    compiler = BytecodeCompiler(optimisation_level=2)
+    programs = [
+        compiler.compile(path, output_format=OutputFormat.LEDCTRL_JSON)[0]
+        for path in inputs
+    ]
+
+    document = tmp_path / "show.json"
+    document.write_bytes(b"[" + b",\n".join(programs) + b"]")
+
+    results = compiler.compile_json_stream(
+        document, output_format=OutputFormat.LEDCTRL_BINARY
+    )
+    for path, result in zip(inputs, results):
+        assert result == (path.with_suffix(".bin").read_bytes(),)
+
+    received = []
+    with document.open("rb") as fp:
+        compiler.compile_json_stream(
+            fp,
+            output_format=OutputFormat.LEDCTRL_JSON,
+            callback=lambda input, result: received.append(result[0]),
+        )
+    assert received == programs
+
+
+def test_chunked_compilation():
+    from random import Random
+
+    from pyledctrl.compiler.ast import StatementSequence
+    from pyledctrl.executor import Executor
+
+    rng = Random(42)
+    lines = []
+    for _ in range(600):
+        if rng.random() < 0.5:
+            lines.extend(
+                ["set_color(255, 0, 0, duration=0.1)", "fade_to_black(duration=0.2)"]
+                * rng.randint(2, 6)
+            )
+        else:
+            color = rng.randint(0, 255), rng.randint(0, 255), rng.randint(0, 255)
+            lines.append("fade_to_color(%d, %d, %d, duration=0.5)" % color)
+
+    def to_source(lines):
+        return "\n".join(lines).encode("utf-8")
+
+    def execute(ast: StatementSequence):
+        return [(state.timestamp, state.color) for state in Executor().execute(ast)]
+
+    compiler = BytecodeCompiler(optimisation_level=2, chunked=True)
+    compiler.compile(to_source(lines), input_format="ledctrl_source")
+    assert compiler._optimiser.hits == 0
+
+    lines[len(lines) // 2] = "set_color(0, 255, 0, duration=0.12)"
+    (chunked,) = compiler.compile(to_source(lines), input_format="ledctrl_source")
+    assert compiler._optimiser.misses < compiler._optimiser.hits
+
+    (fresh,) = BytecodeCompiler(optimisation_level=2, chunked=True).compile(
+        to_source(lines), input_format="ledctrl_source"
+    )
+    (full,) = BytecodeCompiler(optimisation_level=2).compile(
+        to_source(lines), input_format="ledctrl_source"
+    )
+    assert chunked.to_bytecode() == fresh.to_bytecode()
+    assert execute(chunked) == execute(full)
+
+
+def test_chunked_compilation_with_wait_until():
+    from pyledctrl.executor import Executor
+
+    lines = [
+        "set_color(%d, %d, %d, duration=0.1)" % (index % 256, index // 256, 0)
+        for index in range(2000)
+    ]
+    lines[1500] = "wait_until(timestamp=200)"
+
+    def to_source(lines):
+        return "\n".join(lines).encode("utf-8")
+
+    def compile(compiler, lines):
+        (ast,) = compiler.compile(
+            to_source(lines), input_format="ledctrl_source", output_format="ast"
+        )
+        return [(state.timestamp, state.color) for state in Executor().execute(ast)]
+
+    compiler = BytecodeCompiler(optimisation_level=2, chunked=True)
+    for edit in (None, "set_color(0, 0, 255, duration=0.5)"):
+        if edit is not None:
+            lines[10] = edit
+        chunked = compile(compiler, lines)
+        full = compile(BytecodeCompiler(optimisation_level=2), lines)
+        assert chunked == full
+        assert float(chunked[-1][0]) == pytest.approx(249.8)
+
+    assert compiler._optimiser.misses < compiler._optimiser.hits
+
+
+@pytest.mark.parametrize("color_tolerance", [0, 2])
+def test_chunked_optimisation_across_chunk_boundaries(color_tolerance):
+    from random import Random
+
+    from pyledctrl.compiler.chunked import ChunkedASTOptimiser
+    from pyledctrl.executor import Executor
+
+    rng = Random(color_tolerance)
+    lines = []
+    for _ in range(300):
+        color = rng.choice([(255, 0, 0), (254, 1, 0), (0, 0, 255), (12, 200, 40)])
+        lines.extend(
+            [
+                "set_color(%d, %d, %d, duration=0.1)" % color,
+                "fade_to_black(duration=0.2)",
+                "sleep(duration=0.1)",
+            ]
+            * rng.randint(1, 4)
+        )
+        if rng.random() < 0.05:
+            lines.append("wait_until(timestamp=%d)" % (len(lines) * 0.15))
+
+    def compile(compiler, lines):
+        (ast,) = compiler.compile(
+            "\n".join(lines).encode("utf-8"),
+            input_format="ledctrl_source",
+            output_format="ast",
+        )
+        return ast
+
+    def execute(ast):
+        return [(state.timestamp, state.color) for state in Executor().execute(ast)]
+
+    compiler = BytecodeCompiler(
+        optimisation_level=2, chunked=True, color_tolerance=color_tolerance
+    )
+    full_compiler = BytecodeCompiler(
+        optimisation_level=2, color_tolerance=color_tolerance
+    )
+
+    # Use short chunks so loops and merges would span chunk boundaries
+    chunked = compiler._get_optimiser()
+    assert isinstance(chunked, ChunkedASTOptimiser)
+    chunked.min_chunk_length, chunked.max_chunk_length = 8, 32
+    chunked.boundary_divisor = 8
+
+    first = compile(compiler, lines)
+    assert chunked.misses > 10
+    assert execute(first) == execute(compile(full_compiler, lines))
+
+    lines[len(lines) // 2] = "set_color(0, 255, 0, duration=0.3)"
+    edited = compile(compiler, lines)
+    assert chunked.misses < chunked.hits
+    assert execute(edited) == execute(compile(full_compiler, lines))
+
+    # Cached chunks are not shared between the returned ASTs
+    again = compile(compiler, lines)
+    assert chunked.misses == 0
+    assert again.to_bytecode() == edited.to_bytecode()
+    assert not {id(node) for node in edited.statements} & {
+        id(node) for node in again.statements
+    }
+
+
+@pytest.mark.parametrize("tolerance", [1, 2, 3])
+def test_color_quantisation(tolerance):
+    from random import Random
+
+    from pyledctrl.player import Player
+
+    rng = Random(tolerance)
+    base_colors = [(231, 15, 24), (20, 40, 200), (0, 0, 0), (128, 128, 128)]
+
+    def jitter(color):
+        return tuple(min(255, max(0, x + rng.randint(-1, 1))) for x in color)
+
+    lines = []
+    for index in range(200):
+        color = base_colors[index % len(base_colors)]
+        lines.append("set_color(%d, %d, %d, duration=0.2)" % jitter(color))
+        lines.append("fade_to_color(%d, %d, %d, duration=0.2)" % jitter(color))
+    source = "\n".join(lines).encode("utf-8")
+
+    (exact,) = BytecodeCompiler(optimisation_level=2).compile(
+        source, input_format="ledctrl_source"
+    )
+
+    compiler = BytecodeCompiler(optimisation_level=2, color_tolerance=tolerance)
+    (quantised,) = compiler.compile(source, input_format="ledctrl_source")
+    report = compiler.color_quantisation_report
+
+    assert report is not None
+    assert 0 < report.max_error <= tolerance
+    assert report.num_representatives < report.num_colors
+    assert len(quantised.to_bytecode()) < len(exact.to_bytecode()) * (
+        0.8 if tolerance < 2 else 0.1
+    )
+
+    player = Player(quantised)
+    for timestamp, expected in Player(exact).iterate(fps=50):
+        color = player.get_color_at(timestamp)
+        assert all(abs(x - y) <= report.max_error for x, y in zip(color, expected))
+
+    # Quantisation is disabled by default
+    compiler.color_tolerance = 0
+    (result,) = compiler.compile(source, input_format="ledctrl_source")
+    assert compiler.color_quantisation_report is None
+    assert result.to_bytecode() == exact.to_bytecode()
+
+
+@pytest.mark.parametrize("tolerance", [1, 2])
+def test_loop_detection_with_timing_tolerance(tolerance):
+    from random import Random
+
+    from pyledctrl.executor import Executor
+
+    rng = Random(tolerance)
+    lines = []
+    for _ in range(100):
+        lines.append(
+            "set_color(255, 0, 0, duration=%s)" % ((10 + rng.randint(-1, 1)) / 50)
+        )
+        lines.append("fade_to_black(duration=%s)" % ((20 + rng.randint(-1, 1)) / 50))
+        lines.append("sleep(duration=%s)" % ((5 + rng.randint(-1, 1)) / 50))
+    lines.append("set_color(0, 0, 255, duration=1)")
+    source = "\n".join(lines).encode("utf-8")
+
+    def get_red_timestamps(ast):
+        return sorted(
+            {
+                state.timestamp
+                for state in Executor().execute(ast)
+                if not state.is_fade and state.color == (255, 0, 0)
+            }
+        )
+
+    (exact,) = BytecodeCompiler(optimisation_level=2).compile(
+        source, input_format="ledctrl_source"
+    )
+    (tolerant,) = BytecodeCompiler(
+        optimisation_level=2, timing_tolerance=tolerance
+    ).compile(source, input_format="ledctrl_source")
+
+    assert len(tolerant.to_bytecode()) < len(exact.to_bytecode()) * 0.7
+
+    # Each pulse starts at most `tolerance` frames away from where it
+    # started originally, and the whole program takes the same time
+    expected, observed = get_red_timestamps(exact), get_red_timestamps(tolerant)
+    assert len(expected) == len(observed)
+    assert all(abs(x - y) * 50 <= tolerance for x, y in zip(expected, observed))
+    last_exact = list(Executor().execute(exact))[-1]
+    last_tolerant = list(Executor().execute(tolerant))[-1]
+    assert last_exact.timestamp == last_tolerant.timestamp
+    assert last_exact.color == last_tolerant.color
+
+
+def test_dead_code_elimination():
+    from pyledctrl.compiler.ast import (
+        ChannelMask,
+        ChannelValues,
+        Comment,
+        Duration,
+        EndCommand,
+        FadeToBlackCommand,
+        LoopBlock,
+        NopCommand,
+        RGBColor,
+        SetBlackCommand,
+        SetColorCommand,
+        SetPyroAllCommand,
+        SetPyroCommand,
+        SleepCommand,
+        StatementSequence,
+        UnsignedByte,
+    )
+    from pyledctrl.compiler.optimisation import DeadCodeEliminator
+    from pyledctrl.player import Player
+
+    def red(duration):
+        return SetColorCommand(RGBColor(255, 0, 0), Duration(duration))
+
+    def pyro(*channels):
+        return SetPyroCommand(ChannelMask(enable=True, channels=channels))
+
+    def create_ast():
+        return StatementSequence(
+            [
+                NopCommand(),
+                red(0),
+                Comment("overridden"),
+                SetBlackCommand(Duration(10)),
+                red(0),
+                FadeToBlackCommand(Duration(25)),
+                pyro(0, 1),
+                pyro(1),
+                pyro(0),
+                SetPyroAllCommand(ChannelValues((2,))),
+                SleepCommand(Duration(0)),
+                SetPyroAllCommand(ChannelValues((3,))),
+                LoopBlock(
+                    iterations=UnsignedByte(3),
+                    body=StatementSequence(
+                        [
+                            red(0),
+                            red(5),
+                            LoopBlock(
+                                iterations=UnsignedByte(2),
+                                body=StatementSequence([NopCommand(), Comment("x")]),
+                            ),
+                            SetBlackCommand(Duration(5)),
+                        ]
+                    ),
+                ),
+                LoopBlock(
+                    iterations=UnsignedByte(0),
+                    body=StatementSequence([red(50), EndCommand(), red(50)]),
+                ),
+                SetBlackCommand(Duration(50)),
+                EndCommand(),
+            ]
+        )
+
+    original, ast = create_ast(), create_ast()
+    optimiser = DeadCodeEliminator()
+    assert optimiser.optimise(ast)
+    assert not optimiser.optimise(ast)
+
+    statements = [
+        statement for statement in ast.statements if not isinstance(statement, Comment)
+    ]
+    assert StatementSequence(statements).to_led_source().split("\n") == [
+        "set_black(duration=0.2)",
+        "set_color(255, 0, 0, duration=0)",
+        "fade_to_black(duration=0.5)",
+        "pyro_set_all(3)",
+        "with loop(iterations=UnsignedByte(value=3)):",
+        "    set_color(255, 0, 0, duration=0.1)",
+        "    set_black(duration=0.1)",
+        "with loop(iterations=UnsignedByte(value=0)):",
+        "    set_color(255, 0, 0, duration=1)",
+        "    end()",
+    ]
+
+    player = Player(ast)
+    for timestamp, expected in Player(original).iterate(fps=50):
+        assert player.get_color_at(timestamp) == expected
+
+    # The eliminator is part of the default optimisation levels
+    (compiled,) = BytecodeCompiler(optimisation_level=1).compile(
+        b"nop()\nsleep(duration=0)\nset_black(duration=0)\n"
+        b"set_color(1, 2, 3, duration=1)\nend()\nset_white(duration=1)\n",
+        input_format="ledctrl_source",
+    )
+    assert compiled.to_led_source() == "set_color(1, 2, 3, duration=1)\nend()"
+
+
+def test_wait_until_is_replaced_by_sleep():
+    from pyledctrl.compiler.ast import (
+        Duration,
+        FadeToBlackCommand,
+        LoopBlock,
+        RGBColor,
+        SetBlackCommand,
+        SetColorCommand,
+        SetWhiteCommand,
+        StatementSequence,
+        UnsignedByte,
+        WaitUntilCommand,
+    )
+    from pyledctrl.compiler.optimisation import create_optimiser_for_level
+    from pyledctrl.player import Player
+
+    def create_ast():
+        return StatementSequence(
+            [
+                SetColorCommand(RGBColor(255, 0, 0), Duration(50)),
+                WaitUntilCommand(Duration(5000)),
+                LoopBlock(
+                    iterations=UnsignedByte(3),
+                    body=StatementSequence(
+                        [SetBlackCommand(Duration(100)), SetWhiteCommand(Duration(100))]
+                    ),
+                ),
+                WaitUntilCommand(Duration(7500)),
+                FadeToBlackCommand(Duration(50)),
+                WaitUntilCommand(Duration(6000)),
+                SetWhiteCommand(Duration(50)),
+                LoopBlock(
+                    body=StatementSequence(
+                        [
+                            SetBlackCommand(Duration(50)),
+                            WaitUntilCommand(Duration(9000)),
+                        ]
+                    ),
+                ),
+                WaitUntilCommand(Duration(20000)),
+            ]
+        )
+
+    def sample(ast):
+        player = Player(ast)
+        return [player.get_color_at(frame / 4) for frame in range(800)]
+
+    original, optimised = create_ast(), create_ast()
+    assert create_optimiser_for_level(1).optimise(optimised)
+
+    assert len(optimised.to_bytecode()) < len(original.to_bytecode())
+    assert sample(optimised) == sample(original)
+
+    # Waits at known timestamps are replaced (and merged with other commands
+    # where possible), the ones in the past are removed and the ones in loop
+    # bodies or after infinite loops are kept
+    assert optimised.to_led_source().split("\n") == [
+        "set_color(255, 0, 0, duration=100)",
+        "with loop(iterations=UnsignedByte(value=3)):",
+        "    set_black(duration=2)",
+        "    set_white(duration=2)",
+        "sleep(duration=38)",
+        "fade_to_black(duration=1)",
+        "set_white(duration=1)",
+        "with loop(iterations=UnsignedByte(value=0)):",
+        "    set_black(duration=1)",
+        "    wait_until(timestamp=180)",
+        "wait_until(timestamp=400)",
+    ]
+
+    (compiled,) = BytecodeCompiler(optimisation_level=1).compile(
+        b"set_black(duration=1)\nwait_until(timestamp=3)\n",
+        input_format="ledctrl_source",
+    )
+    assert compiled.to_led_source() == "set_black(duration=1)\nsleep(duration=2)\nend()"
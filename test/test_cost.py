@@ -0,0 +1,71 @@
+import pytest
+
+from pyledctrl.compiler.ast import (
+    Duration,
+    FadeToColorCommand,
+    LoopBlock,
+    RGBColor,
+    SetColorCommand,
+    SleepCommand,
+    StatementSequence,
+    WaitUntilCommand,
+)
+from pyledctrl.compiler.cost import (
+    duration_command_cost,
+    loop_cost,
+    statements_cost,
+    varuint_length,
+)
+from pyledctrl.compiler.optimisation import ColorCommandShortener
+from pyledctrl.utils import to_varuint
+
+FRAMES = [0, 1, 127, 128, 16383, 16384, 2097151, 2097152, 2**21 + 5, 2**28 - 1]
+
+
+@pytest.mark.parametrize("value", FRAMES)
+def test_varuint_length(value):
+    assert varuint_length(value) == len(to_varuint(value))
+
+
+@pytest.mark.parametrize("frames", FRAMES)
+def test_duration_command_cost(frames):
+    duration = Duration(frames)
+    assert duration_command_cost(frames) == SleepCommand(duration).length_in_bytes
+    assert duration_command_cost(frames) == WaitUntilCommand(duration).length_in_bytes
+
+
+@pytest.mark.parametrize(
+    "color", [(0, 0, 0), (255, 255, 255), (12, 12, 12), (12, 12, 13), (255, 0, 0)]
+)
+@pytest.mark.parametrize("frames", [0, 200])
+def test_duration_command_cost_of_color_commands(color, frames):
+    shortener = ColorCommandShortener.Transformer()
+    for cls in (SetColorCommand, FadeToColorCommand):
+        command = cls(RGBColor(*color), Duration(frames))
+        assert duration_command_cost(frames, 3) == command.length_in_bytes
+
+        # set_gray() and fade_to_gray() have a single byte argument, while
+        # the black and white variants have none
+        shortened = shortener.visit(command)
+        if isinstance(shortened, cls):
+            num_arg_bytes = 3
+        else:
+            num_arg_bytes = len(shortened._fields) - 1
+        assert duration_command_cost(frames, num_arg_bytes) == (
+            shortened.length_in_bytes
+        )
+
+
+@pytest.mark.parametrize("iterations", [0, 1, 2, 255])
+def test_loop_cost(iterations):
+    body = [
+        SleepCommand(Duration(1)),
+        SetColorCommand(RGBColor(1, 2, 3), Duration(300)),
+    ]
+    loop = LoopBlock(iterations=iterations, body=StatementSequence(body))
+
+    assert statements_cost(body) == 8
+    assert statements_cost(body, 1) == 6
+    assert statements_cost(body, 0, 1) == 2
+    assert loop_cost(iterations, statements_cost(body)) == loop.length_in_bytes
+    assert loop.length_in_bytes == len(loop.to_bytecode())
@@ -2,6 +2,17 @@ from io import StringIO
 from pathlib import Path
 
 from pyledctrl.cli.utils import execute_and_write_tabular
+from pyledctrl.compiler import compile
+from pyledctrl.compiler.ast import (
+    Duration,
+    LoopBlock,
+    RGBColor,
+    SetColorCommand,
+    SleepCommand,
+    StatementSequence,
+    UnsignedByte,
+)
+from pyledctrl.executor import Executor
 
 import gzip
 import pytest
@@ -44,3 +55,56 @@ class TestExecutor:
             assert result == expected
         else:
             assert len(result) > 0
+
+    @pytest.mark.parametrize("input,format,expected", test_data[::2])
+    def test_snapshot_and_resume(self, input, format, expected):
+        def to_tuples(states):
+            return [(state.timestamp, state.color, state.is_fade) for state in states]
+
+        ast = compile(input, input_format="ledctrl_binary", output_format="ast")
+        expected_states = to_tuples(Executor().execute(ast))
+
+        executor = Executor()
+        states = executor.execute(ast)
+        for index in range(len(expected_states) + 1):
+            snapshot = executor.snapshot()
+            resumed = to_tuples(Executor().execute(ast, snapshot))
+            assert resumed == expected_states[index:]
+            next(states, None)
+
+        assert executor.snapshot().path == ()
+
+    def test_snapshot_in_nested_loops(self):
+        ast = StatementSequence(
+            [
+                LoopBlock(
+                    iterations=UnsignedByte(3),
+                    body=StatementSequence(
+                        [
+                            SetColorCommand(RGBColor(255, 0, 0), Duration(10)),
+                            LoopBlock(
+                                iterations=UnsignedByte(2),
+                                body=StatementSequence([SleepCommand(Duration(5))]),
+                            ),
+                        ]
+                    ),
+                )
+            ]
+        )
+
+        executor = Executor()
+        states = executor.execute(ast)
+        for _ in range(5):
+            next(states)
+
+        # Second iteration of the outer loop, first iteration of the inner one
+        snapshot = executor.snapshot()
+        assert snapshot.path == ((1, 0), (2, 1), (1, 0))
+
+        remaining = [state.timestamp for state in states]
+        resumed = [state.timestamp for state in Executor().execute(ast, snapshot)]
+        assert remaining == resumed
+        assert len(resumed) == 4
+
+        with pytest.raises(ValueError):
+            Executor().execute(ast, snapshot._replace(path=((1, 0), (3, 1))))
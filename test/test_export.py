@@ -0,0 +1,237 @@
+from array import array
+from ast import literal_eval
+from io import BytesIO
+from pathlib import Path
+from zipfile import ZipFile
+
+from pyledctrl.archive import ShowArchive
+from pyledctrl.export import export_rgb_stream, export_segments_to_npz
+from pyledctrl.player import Player
+
+import pytest
+
+
+@pytest.fixture
+def show() -> bytes:
+    return (
+        Path(__file__).parent / "data" / "executor" / "show_file_1.bin"
+    ).read_bytes()
+
+
+@pytest.fixture
+def infinite_show() -> bytes:
+    from pyledctrl.compiler import BytecodeCompiler
+
+    source = (
+        b"set_color(0, 255, 0, duration=2)\n"
+        b"with loop(iterations=0):\n"
+        b"    set_color(255, 0, 0, duration=1)\n"
+        b"    fade_to_color(0, 0, 255, duration=1)\n"
+    )
+    (bytecode,) = BytecodeCompiler().compile(
+        source, input_format="ledctrl_source", output_format="ledctrl_binary"
+    )
+    return bytecode
+
+
+@pytest.fixture
+def terminating_loop_show() -> bytes:
+    from pyledctrl.compiler import BytecodeCompiler
+
+    # The infinite loop ends the program in its first iteration, and the
+    # infinite loop after it is never reached
+    source = (
+        b"set_color(0, 255, 0, duration=2)\n"
+        b"with loop(iterations=0):\n"
+        b"    set_color(255, 0, 0, duration=1)\n"
+        b"    fade_to_color(0, 0, 255, duration=1)\n"
+        b"    set_color(255, 255, 0, duration=1)\n"
+        b"    end()\n"
+        b"with loop(iterations=0):\n"
+        b"    set_color(255, 255, 255, duration=1)\n"
+    )
+    (bytecode,) = BytecodeCompiler(optimisation_level=0).compile(
+        source, input_format="ledctrl_source", output_format="ledctrl_binary"
+    )
+    return bytecode
+
+
+def load_npz(data: bytes):
+    """Minimal reader for the .npz files written by the exporter."""
+    typecodes = {"<u4": "I", "<i8": "q", "|u1": "B", "|b1": "B"}
+    result = {}
+    with ZipFile(BytesIO(data)) as archive:
+        for name in archive.namelist():
+            content = archive.read(name)
+            assert content[:8] == b"\x93NUMPY\x01\x00"
+            header_length = int.from_bytes(content[8:10], "little")
+            assert (10 + header_length) % 64 == 0
+            header = literal_eval(content[10 : 10 + header_length].decode("latin1"))
+            items = array(typecodes[header["descr"]])
+            items.frombytes(content[10 + header_length :])
+            values = items.tolist()
+            if len(header["shape"]) == 2:
+                width = header["shape"][1]
+                values = [
+                    tuple(values[i : i + width]) for i in range(0, len(values), width)
+                ]
+            assert len(values) == header["shape"][0]
+            result[name[:-4]] = values
+    return result
+
+
+class TestSegmentExport:
+    @pytest.mark.parametrize("workers", [1, 2])
+    def test_export_segments(self, show, workers):
+        archive = ShowArchive()
+        archive.add_drone(show)
+        archive.add_drone(show, offset=100, rate=2)
+        archive.add_drone(b"")
+
+        output = BytesIO()
+        num_rows = export_segments_to_npz(archive, output, workers=workers)
+        columns = load_npz(output.getvalue())
+
+        timeline = list(Player.from_bytes(show).timeline())
+        rows = columns["drone_rows"]
+        assert rows[:3] == [0, len(timeline), 2 * len(timeline)]
+        assert rows[3] == rows[2] == num_rows
+        assert len(columns["drone"]) == num_rows
+        assert columns["drone"][rows[1] : rows[2]] == [1] * len(timeline)
+
+        for drone, (offset, scale) in enumerate([(0, 1), (100, 0.5)]):
+            for row, segment in zip(range(rows[drone], rows[drone + 1]), timeline):
+                assert columns["start_frame"][row] == offset + round(
+                    segment.start * scale + 0.01
+                )
+                assert columns["end_frame"][row] == offset + round(
+                    segment.end * scale + 0.01
+                )
+                assert columns["start_color"][row] == tuple(segment.start_color)
+                assert columns["end_color"][row] == tuple(segment.end_color)
+                assert columns["is_fade"][row] == segment.is_fade
+
+    def test_export_programs(self, show, tmp_path):
+        path = tmp_path / "segments.npz"
+        num_rows = export_segments_to_npz([show, show], path, compress=True)
+        columns = load_npz(path.read_bytes())
+        assert num_rows == 2 * len(list(Player.from_bytes(show).timeline()))
+        assert columns["drone_rows"] == [0, num_rows // 2, num_rows]
+
+    @pytest.mark.parametrize("workers", [1, 2])
+    def test_export_segments_with_duration(self, show, infinite_show, workers):
+        archive = ShowArchive()
+        archive.add_drone(show)
+        archive.add_drone(show, offset=100, rate=2)
+        archive.add_drone(infinite_show, offset=-50)
+
+        with pytest.raises(ValueError):
+            export_segments_to_npz(archive, BytesIO(), workers=workers)
+
+        output = BytesIO()
+        num_rows = export_segments_to_npz(archive, output, workers=workers, duration=30)
+        columns = load_npz(output.getvalue())
+        rows = columns["drone_rows"]
+        assert rows[3] == num_rows
+
+        timeline = Player.from_bytes(show).timeline()
+        expected = [segment.start for segment in timeline if segment.start < 1500]
+        assert columns["start_frame"][rows[0] : rows[1]] == expected
+        for drone in range(3):
+            starts = columns["start_frame"][rows[drone] : rows[drone + 1]]
+            assert starts and max(starts) < 1500
+
+        # The infinite loop starts at frame 100 - 50 and takes 100 frames
+        infinite_starts = columns["start_frame"][rows[2] : rows[3]]
+        assert infinite_starts == [-50] + list(range(50, 1500, 50))
+
+    def test_export_segments_of_terminating_loop(self, terminating_loop_show):
+        output = BytesIO()
+        num_rows = export_segments_to_npz([terminating_loop_show], output)
+        columns = load_npz(output.getvalue())
+        assert num_rows == 3
+        assert columns["start_frame"] == [0, 100, 150]
+        assert columns["end_frame"] == [100, 150, 200]
+
+
+class TestRGBStreamExport:
+    def test_export_rgb_stream(self, show):
+        archive = ShowArchive()
+        archive.add_drone(show)
+        archive.add_drone(show, offset=50, rate=2)
+        archive.add_drone(b"")
+
+        output = BytesIO()
+        num_frames = export_rgb_stream(
+            archive, output, fps=10, duration=20, order=[1, 0, 1, 2]
+        )
+        assert num_frames == 201
+
+        data = output.getvalue()
+        assert len(data) == num_frames * 4 * 3
+
+        reference = Player.from_bytes(show)
+        for frame in range(num_frames):
+            timestamp = frame / 10
+            first = reference.get_color_at(timestamp)
+            second = reference.get_color_at((timestamp - 1) * 2)
+            expected = bytes(second) + bytes(first) + bytes(second) + bytes(3)
+            assert data[frame * 12 : (frame + 1) * 12] == expected
+
+    def test_export_rgb_stream_until_end(self, show, tmp_path):
+        path = tmp_path / "show.rgb"
+        num_frames = export_rgb_stream([show], path, fps=4)
+        assert num_frames == 161.98 * 4 // 1 + 1
+        assert path.stat().st_size == num_frames * 3
+
+        with pytest.raises(ValueError):
+            export_rgb_stream([show], path, order=[1])
+
+    def test_export_rgb_stream_of_many_drones(self, show):
+        # Most frames refresh only a few drones and are patched; the others
+        # are rebuilt from scratch
+        archive = ShowArchive()
+        for index in range(30):
+            archive.add_drone(show, offset=index * 37)
+
+        output = BytesIO()
+        num_frames = export_rgb_stream(archive, output, fps=5, duration=60)
+        data = output.getvalue()
+        assert len(data) == num_frames * 30 * 3
+
+        cursors = [Player.from_bytes(show).cursor() for _ in range(30)]
+        for frame in range(num_frames):
+            expected = b"".join(
+                bytes(cursor.get_color_at(frame / 5 - index * 37 / 50))
+                for index, cursor in enumerate(cursors)
+            )
+            assert data[frame * 90 : (frame + 1) * 90] == expected
+
+    def test_export_infinite_rgb_stream(self, show, infinite_show):
+        with pytest.raises(ValueError, match="drone 1 never ends"):
+            export_rgb_stream([show, infinite_show, infinite_show], BytesIO())
+
+        output = BytesIO()
+        num_frames = export_rgb_stream(
+            [show, infinite_show], output, fps=2, duration=4.5
+        )
+        assert num_frames == 10
+        assert output.getvalue()[-3:] == bytes(
+            Player.from_bytes(infinite_show).get_color_at(4.5)
+        )
+
+    def test_export_rgb_stream_of_terminating_loop(self, terminating_loop_show):
+        output = BytesIO()
+        num_frames = export_rgb_stream([terminating_loop_show], output, fps=2)
+        assert num_frames == 9
+        assert output.getvalue()[-3:] == bytes([255, 255, 0])
+
+    def test_write_errors(self, show):
+        class FailingStream(BytesIO):
+            def write(self, data):
+                if self.tell() > 100:
+                    raise BrokenPipeError()
+                return super().write(data)
+
+        with pytest.raises(BrokenPipeError):
+            export_rgb_stream([show], FailingStream(), fps=25)
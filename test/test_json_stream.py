@@ -0,0 +1,62 @@
+from base64 import b64encode
+from io import BytesIO, StringIO
+from json import dumps
+
+from pyledctrl.compiler.errors import CompilerError
+from pyledctrl.compiler.json_stream import iter_json_programs, iter_json_values
+
+import pytest
+
+
+def program(data: bytes) -> dict:
+    return {"version": 1, "data": b64encode(data).decode("ascii")}
+
+
+programs = [program(bytes(range(index % 256)) * (index % 5 + 1)) for index in range(50)]
+
+
+@pytest.mark.parametrize("chunk_size", [1, 7, 64, 65536])
+def test_json_array(chunk_size):
+    document = dumps(programs, indent=2)
+    assert list(iter_json_values(StringIO(document), chunk_size)) == programs
+    assert (
+        list(iter_json_values(BytesIO(document.encode("utf-8")), chunk_size))
+        == programs
+    )
+
+
+@pytest.mark.parametrize("chunk_size", [1, 7, 64, 65536])
+def test_newline_delimited_json(chunk_size):
+    document = "\n".join(dumps(item) for item in programs) + "\n"
+    assert list(iter_json_values(StringIO(document), chunk_size)) == programs
+
+
+def test_multibyte_characters_across_chunks():
+    document = dumps(["é€\U0001f600", 12345], ensure_ascii=False)
+    values = iter_json_values(BytesIO(document.encode("utf-8")), 1)
+    assert list(values) == ["é€\U0001f600", 12345]
+
+
+def test_empty_inputs():
+    assert list(iter_json_values(StringIO(""))) == []
+    assert list(iter_json_values(StringIO(" [ ] "))) == []
+
+
+@pytest.mark.parametrize(
+    "document",
+    ["[1,]", "[1 2]", "[1", "[,1]", "[1] 2", "{", '{"a": 1'],
+)
+def test_invalid_json(document):
+    with pytest.raises(CompilerError):
+        list(iter_json_values(StringIO(document), 2))
+
+
+def test_iter_json_programs():
+    document = dumps(programs)
+    decoded = list(iter_json_programs(StringIO(document), 16))
+    assert decoded == [bytes(range(i % 256)) * (i % 5 + 1) for i in range(50)]
+
+    with pytest.raises(CompilerError, match="version"):
+        list(iter_json_programs(StringIO('[{"version": 2, "data": ""}]')))
+    with pytest.raises(CompilerError, match="JSON object"):
+        list(iter_json_programs(StringIO("[1]")))
@@ -0,0 +1,153 @@
+from pathlib import Path
+
+from pyledctrl.metrics import MetricsRegistry, registry
+from pyledctrl.player import Player, PlayerCursor
+from pyledctrl.swarm import SwarmPlayer
+
+import pytest
+
+
+@pytest.fixture
+def show() -> bytes:
+    return (
+        Path(__file__).parent / "data" / "executor" / "show_file_1.bin"
+    ).read_bytes()
+
+
+@pytest.fixture
+def enabled_registry():
+    registry.reset()
+    registry.enable()
+    try:
+        yield registry
+    finally:
+        registry.disable()
+        registry.reset()
+
+
+class TestMetricsRegistry:
+    def test_counters_and_histograms(self):
+        metrics = MetricsRegistry()
+        counter = metrics.counter("requests_total", "Number of requests")
+        assert metrics.counter("requests_total") is counter
+        counter.inc()
+        counter.inc(2)
+
+        histogram = metrics.histogram("latency_seconds", "Latency", (0.1, 1))
+        for value in (0.05, 0.1, 0.5, 3):
+            histogram.observe(value)
+
+        assert metrics.as_dict() == {
+            "latency_seconds": {
+                "count": 4,
+                "sum": 3.65,
+                "buckets": {0.1: 2, 1.0: 3, float("inf"): 4},
+            },
+            "requests_total": 3,
+        }
+        assert metrics.to_prometheus() == (
+            "# HELP latency_seconds Latency\n"
+            "# TYPE latency_seconds histogram\n"
+            'latency_seconds_bucket{le="0.1"} 2\n'
+            'latency_seconds_bucket{le="1.0"} 3\n'
+            'latency_seconds_bucket{le="+Inf"} 4\n'
+            "latency_seconds_sum 3.65\n"
+            "latency_seconds_count 4\n"
+            "# HELP requests_total Number of requests\n"
+            "# TYPE requests_total counter\n"
+            "requests_total 3\n"
+        )
+
+        with pytest.raises(ValueError):
+            metrics.histogram("requests_total")
+
+        metrics.reset()
+        assert metrics.as_dict()["requests_total"] == 0
+        assert metrics.as_dict()["latency_seconds"]["count"] == 0
+
+
+class TestPlayerMetrics:
+    def test_disabled_by_default(self, show):
+        assert not registry.enabled
+        assert type(Player.from_bytes(show).cursor()) is PlayerCursor
+
+    def test_player_metrics(self, show, enabled_registry):
+        player = Player.from_bytes(show)
+        timestamps = [frame / 25 for frame in range(25 * 20)]
+        for timestamp in timestamps:
+            player.get_color_at(timestamp)
+        player.get_color_at(3)
+        player.get_color_at_frame(100)
+
+        stats = enabled_registry.as_dict()
+        assert stats["pyledctrl_player_queries_total"] == len(timestamps) + 2
+        assert stats["pyledctrl_player_rewinds_total"] == 2
+        assert (
+            stats["pyledctrl_player_cursor_hits_total"]
+            + stats["pyledctrl_player_cursor_misses_total"]
+            == len(timestamps) + 2
+        )
+        assert 0 < stats["pyledctrl_player_cursor_misses_total"] < len(timestamps)
+        assert (
+            stats["pyledctrl_player_seek_distance_events"]["count"]
+            == stats["pyledctrl_player_cursor_misses_total"]
+        )
+        assert stats["pyledctrl_player_query_seconds"]["count"] == len(timestamps) + 2
+        assert stats["pyledctrl_player_events_total"] > 0
+
+        text = enabled_registry.to_prometheus()
+        assert "# TYPE pyledctrl_player_queries_total counter\n" in text
+        assert 'pyledctrl_player_query_seconds_bucket{le="+Inf"}' in text
+
+    def test_players_created_before_enabling(self, show):
+        registry.reset()
+        player = Player.from_bytes(show)
+        cursor = player.cursor()
+        player.get_color_at(1)
+        assert registry.as_dict()["pyledctrl_player_queries_total"] == 0
+
+        registry.enable()
+        try:
+            player.get_color_at(2)
+            cursor.get_color_at(3)
+            cursor.get_color_at_frame(100)
+            stats = registry.as_dict()
+        finally:
+            registry.disable()
+            registry.reset()
+
+        assert stats["pyledctrl_player_queries_total"] == 3
+        assert stats["pyledctrl_player_rewinds_total"] == 1
+
+    def test_iterate_metrics(self, show, enabled_registry):
+        player = Player.from_bytes(show)
+        frames = list(player.iterate(5))
+
+        stats = enabled_registry.as_dict()
+        assert stats["pyledctrl_player_queries_total"] == len(frames)
+        assert stats["pyledctrl_player_query_seconds"]["count"] == len(frames)
+
+        enabled_registry.disable()
+        assert list(Player.from_bytes(show).iterate(5)) == frames
+
+    def test_replay_metrics(self, show, enabled_registry):
+        player = Player.from_bytes(show, max_events=4)
+        player.get_color_at(100)
+        player.get_color_at(10)
+        player.get_color_at(11)
+        player.get_color_at(3)
+
+        stats = enabled_registry.as_dict()
+        assert stats["pyledctrl_player_replays_total"] == 2
+        assert stats["pyledctrl_player_rewinds_total"] == 2
+
+    def test_swarm_metrics(self, show, enabled_registry):
+        swarm = SwarmPlayer(Player.from_bytes(show) for _ in range(3))
+        refreshed = 0
+        for frame in range(100):
+            refreshed += len(swarm.sample(frame / 25).refreshed)
+
+        stats = enabled_registry.as_dict()
+        assert stats["pyledctrl_swarm_frame_seconds"]["count"] == 100
+        assert stats["pyledctrl_swarm_refreshed_total"] == refreshed
+        assert stats["pyledctrl_swarm_reused_total"] == 300 - refreshed
@@ -1,5 +1,6 @@
 from pathlib import Path
 from random import shuffle, seed
+from threading import Thread
 from typing import Tuple
 
 from pyledctrl.player import Player
@@ -59,3 +60,303 @@ class TestPlayer:
         for timestamp, expected_color in expected:
             color = player.get_color_at(timestamp)
             assert almost_same_color(color, expected_color)
+
+    @pytest.mark.parametrize("input,expected", test_data)
+    def test_independent_cursors(self, input, expected):
+        # Other tests may have shuffled the expected data in-place
+        expected = sorted(expected)
+
+        player = Player.from_bytes(input)
+        forward = player.cursor()
+        backward = player.cursor()
+
+        # Interleaved queries in opposite directions do not interfere
+        for (t1, color1), (t2, color2) in zip(expected, reversed(expected)):
+            assert almost_same_color(forward.get_color_at(t1), color1)
+            assert almost_same_color(backward.get_color_at(t2), color2)
+
+        assert forward.ended and not backward.ended
+        assert not player.ended
+
+    @pytest.mark.parametrize("input,expected", test_data)
+    def test_cursors_in_threads(self, input, expected):
+        from concurrent.futures import ThreadPoolExecutor
+
+        player = Player.from_bytes(input)
+
+        def check(offset):
+            cursor = player.cursor()
+            items = expected[offset:] + expected[:offset]
+            return all(
+                almost_same_color(cursor.get_color_at(timestamp), color)
+                for timestamp, color in items
+            )
+
+        with ThreadPoolExecutor(max_workers=4) as executor:
+            offsets = range(0, len(expected), max(1, len(expected) // 8))
+            assert all(executor.map(check, offsets))
+
+    @pytest.mark.parametrize("input,expected", test_data)
+    def test_snapshot_and_restore(self, input, expected):
+        import json
+
+        expected = sorted(expected)
+        middle = len(expected) // 2
+
+        player = Player.from_bytes(input)
+        for timestamp, _ in expected[:middle]:
+            player.get_color_at(timestamp)
+
+        snapshot = json.loads(json.dumps(player.snapshot(), default=str))
+
+        restored = Player.from_bytes(input)
+        restored.restore(snapshot)
+        for timestamp, expected_color in expected[middle:]:
+            color = restored.get_color_at(timestamp)
+            assert almost_same_color(color, expected_color)
+        assert restored.ended
+
+        with pytest.raises(ValueError):
+            restored.get_color_at(expected[0][0])
+
+    @pytest.mark.parametrize("input,expected", test_data)
+    def test_frame_queries(self, input, expected):
+        player = Player.from_bytes(input)
+        for timestamp, expected_color in sorted(expected):
+            frame = round(timestamp * 50)
+            assert almost_same_color(player.get_color_at_frame(frame), expected_color)
+            assert almost_same_color(
+                player.get_color_at_frame(frame * 2, fps=100), expected_color
+            )
+
+    @pytest.mark.parametrize("input,expected", test_data)
+    def test_iterate_frames_at_rates(self, input, expected):
+        from fractions import Fraction
+
+        rates = [25, 50, Fraction(30000, 1001)]
+        player = Player.from_bytes(input)
+        items = list(player.iterate_frames_at_rates(rates))
+
+        # A single sweep gives the same frames as separate iterations
+        for index, rate in enumerate(rates):
+            frames = [(frame, color) for i, frame, color in items if i == index]
+            assert frames == list(Player.from_bytes(input).iterate_frames(rate))
+            assert [frame for frame, _ in frames] == list(range(len(frames)))
+
+        # Frames are in chronological order
+        times = [Fraction(frame) / rates[index] for index, frame, _ in items]
+        assert times == sorted(times)
+
+        # The last frames of each rate are at or after the end of the show
+        end = max(timestamp for timestamp, _ in expected)
+        for index, rate in enumerate(rates):
+            last = max(frame for i, frame, _ in items if i == index)
+            assert last / rate >= end > (last - 1) / rate
+
+    @pytest.mark.parametrize("input,expected", test_data)
+    @pytest.mark.parametrize("fps", [1, 7, 25, 60, 1000])
+    def test_iterate_matches_queries(self, input, expected, fps):
+        player = Player.from_bytes(input)
+        frames = list(player.iterate(fps))
+        assert player.ended
+
+        # iterate() walks the timeline in segments; it must give exactly the
+        # same timestamps and colors as querying each frame separately
+        cursor = Player.from_bytes(input).cursor()
+        seconds, frame, t, dt = 0, 0, 0, 1.0 / fps
+        for index, (timestamp, color) in enumerate(frames):
+            assert timestamp == t
+            assert color == cursor.get_color_at(t)
+            assert cursor.ended == (index == len(frames) - 1)
+            t += dt
+            frame += 1
+            if frame == fps:
+                seconds, frame = seconds + 1, 0
+                t = seconds
+
+    @pytest.mark.parametrize("input,expected", test_data)
+    def test_timeline(self, input, expected):
+        player = Player.from_bytes(input)
+        assert not player.is_infinite
+
+        timeline = list(player.timeline())
+        assert all(segment.start < segment.end for segment in timeline)
+        assert all(x.end == y.start for x, y in zip(timeline, timeline[1:]))
+        for segment in timeline:
+            assert player.get_color_at_frame(segment.start) == segment.start_color
+
+        limit = timeline[len(timeline) // 2].start
+        assert list(player.timeline(until=limit)) == timeline[: len(timeline) // 2]
+        assert (
+            list(player.timeline(until=limit + 1)) == timeline[: len(timeline) // 2 + 1]
+        )
+
+
+def test_infinite_timeline():
+    from pyledctrl.compiler import BytecodeCompiler
+
+    compiler = BytecodeCompiler()
+    source = (
+        b"set_color(0, 255, 0, duration=2)\n"
+        b"with loop(iterations=0):\n"
+        b"    set_color(255, 0, 0, duration=1)\n"
+        b"    fade_to_color(0, 0, 255, duration=1)\n"
+    )
+    (bytecode,) = compiler.compile(
+        source, input_format="ledctrl_source", output_format="ledctrl_binary"
+    )
+    player = Player.from_bytes(bytecode)
+    assert player.is_infinite
+
+    with pytest.raises(ValueError):
+        player.timeline()
+
+    # Frames are at 50 fps; the loop starts at frame 100 and takes 100 frames
+    timeline = list(player.timeline(until=1000))
+    assert [segment.start for segment in timeline] == [0] + list(range(100, 1000, 50))
+    assert timeline[-1].end == 1000
+    assert not timeline[1].is_fade and timeline[2].is_fade
+    assert player.get_color_at(3599.5) == (128, 0, 128)
+
+    (bytecode,) = compiler.compile(
+        source.replace(b"with", b"end()\nwith"),
+        input_format="ledctrl_source",
+        output_format="ledctrl_binary",
+    )
+    assert not Player.from_bytes(bytecode).is_infinite
+
+
+@pytest.mark.parametrize("input,expected", load_test_data())
+def test_queries_before_start(input, expected):
+    assert Player.from_bytes(input).get_color_at(-1) == (0, 0, 0)
+    assert Player.from_bytes(input).get_color_at_frame(-1) == (0, 0, 0)
+
+
+class TestBoundedPlayer:
+    @pytest.mark.parametrize("input,expected", load_test_data())
+    def test_matches_unbounded_player(self, input, expected):
+        reference = Player.from_bytes(input)
+        player = Player.from_bytes(input, max_events=8)
+
+        seed(42)
+        timestamps = [timestamp for timestamp, _ in expected]
+        shuffle(timestamps)
+        cursor = player.cursor()
+        for timestamp in timestamps:
+            assert player.get_color_at(timestamp) == reference.get_color_at(timestamp)
+            assert cursor.get_color_at_frame(int(timestamp * 50)) == (
+                reference.get_color_at_frame(int(timestamp * 50))
+            )
+            assert len(player._log.events) <= 16
+
+        assert list(player.timeline()) == list(reference.timeline())
+        assert list(player.iterate(25)) == list(reference.iterate(25))
+        assert len(player._log.events) <= 16
+
+    def test_infinite_program(self):
+        from pyledctrl.compiler import BytecodeCompiler
+
+        source = (
+            b"with loop(iterations=0):\n"
+            b"    set_color(255, 0, 0, duration=0.1)\n"
+            b"    fade_to_color(0, 0, 255, duration=0.1)\n"
+        )
+        (bytecode,) = BytecodeCompiler().compile(
+            source, input_format="ledctrl_source", output_format="ledctrl_binary"
+        )
+        reference = Player.from_bytes(bytecode)
+        player = Player.from_bytes(bytecode, max_events=100)
+        cursor = player.cursor()
+
+        assert player.get_color_at(3600.15) == reference.get_color_at(3600.15)
+        log = player._log
+        assert len(log.events) <= 200
+        num_events = log.position + len(log.events)
+        assert len(log._checkpoints) == (num_events - 2) // 100 + 1
+
+        # Earlier queries replay the program from the nearest checkpoint,
+        # without moving the shared window
+        position = log.position
+        assert cursor.get_color_at(1800.05) == reference.get_color_at(1800.05)
+        assert 0 < num_events / 2 - cursor._replay.position < 200
+        assert player.get_color_at(0.15) == reference.get_color_at(0.15)
+        assert player._cursor._replay.position == 0
+        assert log.position == position
+
+        # Cursors return to the shared window when they catch up with it
+        assert cursor.get_color_at(3600.15) == reference.get_color_at(3600.15)
+        assert cursor._replay is None
+
+        timeline = list(player.timeline(until=72000))
+        assert len(timeline) == 14400
+        assert len(log.events) <= 200
+        assert log.position == position
+
+        with pytest.raises(ValueError):
+            Player.from_bytes(bytecode, max_events=1)
+
+    def test_cursors_do_not_interfere(self):
+        data_dir = Path(__file__).parent / "data" / "executor"
+        input = (data_dir / "show_file_1.bin").read_bytes()
+        reference = Player.from_bytes(input)
+        player = Player.from_bytes(input, max_events=4)
+
+        # Two cursors play different parts of the show; each of them replays
+        # the show at most once and the shared window only moves forward
+        late, early = player.cursor(), player.cursor()
+        late.get_color_at(100)
+        position = player._log.position
+        replays = set()
+        for step in range(200):
+            timestamp = step / 10
+            assert late.get_color_at(100 + timestamp) == (
+                reference.get_color_at(100 + timestamp)
+            )
+            assert early.get_color_at(timestamp) == reference.get_color_at(timestamp)
+            replays.add(id(early._replay))
+            assert player._log.position >= position
+            position = player._log.position
+
+        assert late._replay is None
+        assert len(replays) == 1
+
+    def test_threads(self):
+        data_dir = Path(__file__).parent / "data" / "executor"
+        input = (data_dir / "show_file_1.bin").read_bytes()
+        reference = Player.from_bytes(input)
+        player = Player.from_bytes(input, max_events=4)
+        timestamps = [step / 5 for step in range(5 * 170)]
+        expected = [reference.get_color_at(timestamp) for timestamp in timestamps]
+        errors = []
+
+        def play(offset):
+            cursor = player.cursor()
+            try:
+                for _ in range(3):
+                    for index in range(offset, len(timestamps)):
+                        color = cursor.get_color_at(timestamps[index])
+                        assert color == expected[index], timestamps[index]
+            except Exception as ex:
+                errors.append(ex)
+
+        threads = [Thread(target=play, args=(offset,)) for offset in range(0, 800, 50)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+
+        assert errors == []
+
+    def test_snapshot_and_restore(self):
+        data_dir = Path(__file__).parent / "data" / "executor"
+        input = (data_dir / "show_file_1.bin").read_bytes()
+        reference = Player.from_bytes(input)
+        player = Player.from_bytes(input, max_events=4)
+
+        player.get_color_at(40)
+        player.restore(player.snapshot())
+        for timestamp in range(40, 170):
+            assert player.get_color_at(timestamp) == reference.get_color_at(timestamp)
+        assert player.get_color_at(45) == reference.get_color_at(45)
+        with pytest.raises(ValueError):
+            player.get_color_at(20)
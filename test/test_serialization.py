@@ -0,0 +1,185 @@
+import copyreg
+import pickle
+import pytest
+
+from io import BytesIO
+from pathlib import Path
+from time import perf_counter
+
+from pyledctrl.compiler import BytecodeCompiler
+from pyledctrl.compiler.ast import (
+    ChannelMask,
+    ChannelValues,
+    Comment,
+    Duration,
+    EndCommand,
+    FadeToColorCommand,
+    LoopBlock,
+    Node,
+    RGBColor,
+    SetColorCommand,
+    SetPyroAllCommand,
+    SetPyroCommand,
+    SleepCommand,
+    StatementSequence,
+    UnsignedByte,
+)
+from pyledctrl.compiler.errors import BytecodeParserError, InvalidASTFormatError
+from pyledctrl.compiler.serialization import dump_ast, load_ast
+from pyledctrl.parsers.bytecode import BytecodeParser
+
+
+def compile_test_data(optimisation_level=0):
+    data_dir = Path(__file__).parent / "data" / "compiler"
+    compiler = BytecodeCompiler(optimisation_level=optimisation_level)
+    return [
+        pytest.param(
+            compiler.compile(path, output_format="ast")[0],
+            id=(
+                path.stem
+                if optimisation_level == 0
+                else "{0}-O{1}".format(path.stem, optimisation_level)
+            ),
+        )
+        for path in sorted(data_dir.glob("*.led"))
+        if not path.name.startswith("_")
+    ]
+
+
+def create_large_program(length):
+    statements = []
+    for index in range(length):
+        color = RGBColor(index % 256, index * 7 % 256, index * 13 % 256)
+        if index % 3 == 0:
+            statements.append(SetColorCommand(color, Duration(index % 500 + 1)))
+        elif index % 3 == 1:
+            statements.append(FadeToColorCommand(color, Duration(index % 300 + 1)))
+        else:
+            statements.append(SleepCommand(Duration(index % 50 + 1)))
+    return StatementSequence(statements)
+
+
+def pickle_node_by_node(ast):
+    """Pickles an abstract syntax tree the generic way, one object per node,
+    bypassing the compact format that statements use when they are pickled.
+    """
+
+    def reduce(node):
+        return copyreg.__newobj__, (type(node),), node.__getstate__()
+
+    def subclasses(cls):
+        for subclass in cls.__subclasses__():
+            yield subclass
+            yield from subclasses(subclass)
+
+    buffer = BytesIO()
+    pickler = pickle.Pickler(buffer)
+    pickler.dispatch_table = {cls: reduce for cls in subclasses(Node)}
+    pickler.dump(ast)
+    return buffer.getvalue()
+
+
+@pytest.mark.parametrize("ast", compile_test_data())
+def test_round_trip_of_compiled_programs(ast):
+    data = dump_ast(ast)
+    restored = load_ast(data)
+
+    assert repr(restored) == repr(ast)
+    assert restored.to_bytecode() == ast.to_bytecode()
+
+    # Serialized form is about as compact as the bytecode itself
+    assert len(data) < len(ast.to_bytecode()) + 16 + 4 * len(ast.statements)
+
+
+@pytest.mark.parametrize(
+    "ast", compile_test_data() + compile_test_data(optimisation_level=2)
+)
+def test_size_compared_to_pickle(ast):
+    data = dump_ast(ast)
+    assert len(data) < len(pickle_node_by_node(ast))
+
+    # Pickling a statement uses the compact format, with a constant overhead
+    assert len(pickle.dumps(ast)) < len(data) + 100
+
+
+def test_large_program():
+    ast = create_large_program(10000)
+    data = dump_ast(ast)
+    bytecode = ast.to_bytecode()
+
+    assert load_ast(data).to_bytecode() == bytecode
+    assert len(data) * 5 < len(pickle_node_by_node(ast))
+
+
+@pytest.mark.benchmark
+def test_loading_speed():
+    ast = create_large_program(50000)
+    data = dump_ast(ast)
+    bytecode = ast.to_bytecode()
+
+    def measure(func, *args):
+        best = float("inf")
+        for _ in range(3):
+            start = perf_counter()
+            func(*args)
+            best = min(best, perf_counter() - start)
+        return best
+
+    load_time = measure(load_ast, data)
+    parse_time = measure(BytecodeParser().parse, bytecode)
+    print(
+        "load_ast(): {0:.3f}s, parsing the bytecode: {1:.3f}s".format(
+            load_time, parse_time
+        )
+    )
+    assert load_time < parse_time
+
+
+def test_round_trip_of_special_nodes():
+    ast = StatementSequence(
+        [
+            Comment("first"),
+            LoopBlock(
+                iterations=UnsignedByte(1),
+                body=StatementSequence(
+                    [
+                        SetColorCommand(RGBColor(1, 2, 3), Duration(300)),
+                        Comment("first"),
+                        LoopBlock(iterations=UnsignedByte(7)),
+                    ]
+                ),
+            ),
+            SetPyroCommand(ChannelMask(enable=True, channels=(0, 6))),
+            SetPyroAllCommand(ChannelValues((2, 3))),
+            StatementSequence([SleepCommand(Duration(0)), Comment("ünïcödé")]),
+            EndCommand(),
+        ]
+    )
+
+    data = dump_ast(ast)
+    assert repr(load_ast(data)) == repr(ast)
+
+    # Repeated comments are stored only once
+    assert data.count(b"first") == 1
+
+    # Pickling uses the same compact representation
+    assert repr(pickle.loads(pickle.dumps(ast))) == repr(ast)
+    assert repr(pickle.loads(pickle.dumps(ast.statements[1]))) == repr(
+        ast.statements[1]
+    )
+
+
+def test_invalid_input():
+    data = dump_ast(StatementSequence([EndCommand()]))
+
+    with pytest.raises(InvalidASTFormatError):
+        load_ast(b"foobar" + data)
+
+    with pytest.raises(BytecodeParserError):
+        load_ast(data[:-1])
+
+    with pytest.raises(BytecodeParserError):
+        load_ast(data + b"\x00")
+
+    with pytest.raises(BytecodeParserError):
+        load_ast(data[:-1] + b"\xfe")
@@ -0,0 +1,100 @@
+from pathlib import Path
+
+from pyledctrl.player import Player
+from pyledctrl.swarm import SwarmPlayer
+
+import pytest
+
+
+@pytest.fixture
+def show() -> bytes:
+    return (
+        Path(__file__).parent / "data" / "executor" / "show_file_1.bin"
+    ).read_bytes()
+
+
+def max_difference(first, second) -> int:
+    return max(abs(x - y) for x, y in zip(first, second))
+
+
+def sample_timestamps(fps: int = 25, duration: float = 165):
+    return [frame / fps for frame in range(int(duration * fps))]
+
+
+class TestSwarmPlayer:
+    def test_exact_sampling(self, show):
+        swarm = SwarmPlayer(Player.from_bytes(show) for _ in range(5))
+        reference = Player.from_bytes(show)
+
+        num_refreshed = 0
+        for timestamp in sample_timestamps():
+            colors, refreshed = swarm.sample(timestamp)
+            assert colors == [reference.get_color_at(timestamp)] * 5
+            num_refreshed += len(refreshed)
+
+        # Constant segments are not evaluated again
+        assert 0 < num_refreshed < 5 * len(sample_timestamps()) / 2
+
+    def test_error_budget(self, show):
+        timestamps = sample_timestamps()
+        reference = Player.from_bytes(show)
+        expected = [reference.get_color_at(timestamp) for timestamp in timestamps]
+
+        counts = []
+        for tolerance in (0, 8, 32):
+            swarm = SwarmPlayer([Player.from_bytes(show)])
+            count = 0
+            for timestamp, expected_color in zip(timestamps, expected):
+                colors, refreshed = swarm.sample(timestamp, tolerance)
+                assert max_difference(colors[0], expected_color) <= tolerance + 1
+                count += len(refreshed)
+            counts.append(count)
+
+        assert counts[0] > counts[1] > counts[2]
+
+    def test_level_of_detail(self, show):
+        swarm = SwarmPlayer(Player.from_bytes(show) for _ in range(3))
+        swarm.detail = [1, 0.1, 0]
+
+        counts = [0, 0, 0]
+        for timestamp in sample_timestamps():
+            _, refreshed = swarm.sample(timestamp, tolerance=2)
+            for index in refreshed:
+                counts[index] += 1
+
+        assert counts[0] > counts[1] > counts[2] > 0
+
+        with pytest.raises(ValueError):
+            swarm.detail = [1, 1]
+        with pytest.raises(ValueError):
+            swarm.detail = [1, 2, 1]
+
+    def test_rewind_refreshes_everything(self, show):
+        swarm = SwarmPlayer(Player.from_bytes(show) for _ in range(4))
+        swarm.sample(10)
+        assert swarm.sample(10.01).refreshed != [0, 1, 2, 3]
+        assert swarm.sample(5).refreshed == [0, 1, 2, 3]
+
+    def test_time_bases(self, show):
+        reference = Player.from_bytes(show)
+        shared = Player.from_bytes(show)
+        offsets = [0, 0.5, 3.25, -2]
+        rates = [1, 1, 0.5, 2]
+        swarm = SwarmPlayer([shared] * 4, offsets=offsets, rates=rates)
+        assert swarm.offsets == offsets
+        assert swarm.rates == rates
+
+        for tolerance in (0, 16):
+            swarm.invalidate()
+            for timestamp in sample_timestamps():
+                colors, _ = swarm.sample(timestamp, tolerance)
+                for color, offset, rate in zip(colors, offsets, rates):
+                    expected = reference.get_color_at((timestamp - offset) * rate)
+                    assert max_difference(color, expected) <= tolerance + 1
+                    if not tolerance:
+                        assert color == expected
+
+        with pytest.raises(ValueError):
+            SwarmPlayer([shared] * 2, offsets=[0])
+        with pytest.raises(ValueError):
+            SwarmPlayer([shared] * 2, rates=[1, 0])
@@ -0,0 +1,73 @@
+import pytest
+
+from array import array
+from io import BufferedReader, BytesIO
+from random import Random
+
+from pyledctrl.varuint import (
+    decode_varuint,
+    decode_varuints,
+    encode_varuint,
+    encode_varuints,
+    read_varuint,
+    varuint_length,
+)
+
+VALUES = [0, 1, 127, 128, 300, 16383, 16384, 2097151, 2097152, 2**28 - 1, 2**40]
+
+
+def reference_encode(value):
+    result = []
+    while value >= 128:
+        result.append((value & 0x7F) | 0x80)
+        value >>= 7
+    result.append(value)
+    return bytes(result)
+
+
+@pytest.mark.parametrize("value", VALUES)
+def test_encode_and_decode(value):
+    encoded = encode_varuint(value)
+    assert encoded == reference_encode(value)
+    assert varuint_length(value) == len(encoded)
+    assert decode_varuint(b"\xff" + encoded + b"\x00", 1) == (value, len(encoded) + 1)
+
+
+def test_batch_encode_and_decode():
+    rng = Random(86)
+    values = [rng.choice(VALUES) + rng.randint(0, 100) for _ in range(1000)]
+    encoded = encode_varuints(values)
+    assert encoded == b"".join(reference_encode(value) for value in values)
+
+    for buffer in (encoded, bytearray(encoded), memoryview(encoded)):
+        assert decode_varuints(buffer) == (values, len(encoded))
+
+    assert decode_varuints(array("B", encoded), count=3) == (
+        values[:3],
+        sum(len(reference_encode(value)) for value in values[:3]),
+    )
+
+
+def test_invalid_input():
+    with pytest.raises(ValueError):
+        encode_varuint(-1)
+    with pytest.raises(ValueError):
+        encode_varuints([1, -1])
+    with pytest.raises(EOFError):
+        decode_varuint(b"\x80\x80")
+    with pytest.raises(EOFError):
+        decode_varuints(b"\x01\x02", count=3)
+    with pytest.raises(EOFError):
+        read_varuint(BytesIO(b"\x80"))
+
+
+def test_read_varuint_from_stream():
+    data = encode_varuints(VALUES)
+
+    for stream in (
+        BytesIO(data),
+        BufferedReader(BytesIO(data)),
+        BufferedReader(BytesIO(data), buffer_size=3),
+    ):
+        assert [read_varuint(stream) for _ in VALUES] == VALUES
+        assert stream.read() == b""
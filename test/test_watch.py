@@ -0,0 +1,172 @@
+import os
+import pytest
+
+from pathlib import Path
+from threading import Event, Thread
+from time import perf_counter
+from types import SimpleNamespace
+
+from pyledctrl.cli.watch import PollingFileMonitor, Watcher, _get_changed_path
+from pyledctrl.compiler import compile
+
+
+def write(path, contents, mtime=None):
+    path.write_text(contents)
+    if mtime is not None:
+        os.utime(path, (mtime, mtime))
+
+
+def test_watcher_compiles_outdated_and_changed_files(tmp_path):
+    first = tmp_path / "first.led"
+    second = tmp_path / "sub" / "second.led"
+    second.parent.mkdir()
+
+    write(first, "set_color(255, 0, 0, duration=1)\n", mtime=1000)
+    write(second, "set_color(0, 255, 0, duration=1)\n", mtime=1000)
+
+    # Output of the second file is up-to-date
+    (tmp_path / "sub" / "second.bin").write_bytes(b"")
+
+    monitor = PollingFileMonitor(tmp_path, interval=0.01)
+    watcher = Watcher(monitor, debounce=0)
+
+    results = watcher.compile_outdated_files()
+    assert [result.input for result in results] == [str(first)]
+    assert results[0].error is None
+    assert results[0].output == str(tmp_path / "first.bin")
+    assert (tmp_path / "first.bin").read_bytes() == compile(
+        str(first), output_format="ledctrl_binary"
+    )
+
+    # Touching a file without changing its contents does not recompile it
+    write(second, "set_color(0, 255, 0, duration=1)\n", mtime=2000)
+    assert monitor.poll() == {str(second)}
+    assert watcher.compile_files([str(second)]) == []
+
+    # Compilation errors are reported but do not stop the watcher
+    write(first, "set_color(\n", mtime=3000)
+    (result,) = watcher.compile_files(monitor.poll())
+    assert result.input == str(first)
+    assert result.output is None
+    assert result.error is not None
+
+    # No temporary files are left behind
+    assert sorted(os.listdir(tmp_path)) == ["first.bin", "first.led", "sub"]
+
+
+def test_watcher_exact_mode(tmp_path):
+    source = tmp_path / "show.led"
+    write(
+        source,
+        "set_color(255, 0, 0, duration=0.1)\n"
+        "fade_to_black(duration=0.2)\n"
+        "set_color(0, 0, 7, duration=0.1)\n" * 5000,
+    )
+    expected = compile(
+        str(source), output_format="ledctrl_binary", optimisation_level=2
+    )
+
+    # Chunked optimisation does not detect loops across chunk boundaries
+    monitor = PollingFileMonitor(tmp_path, interval=0.01)
+    (result,) = Watcher(monitor, debounce=0).compile_files([str(source)])
+    assert result.error is None
+    chunked = (tmp_path / "show.bin").read_bytes()
+    assert len(chunked) > len(expected)
+
+    (result,) = Watcher(monitor, debounce=0, chunked=False).compile_files([str(source)])
+    assert result.error is None
+    assert (tmp_path / "show.bin").read_bytes() == expected
+
+
+def test_watcher_run(tmp_path):
+    source = tmp_path / "show.led"
+    write(source, "set_color(255, 0, 0, duration=1)\n")
+
+    monitor = PollingFileMonitor(tmp_path, interval=0.01)
+    watcher = Watcher(monitor, output_format="ledctrl_source", debounce=0.02)
+    results = []
+    stop = Event()
+
+    def callback(result):
+        results.append(result)
+        stop.set()
+
+    thread = Thread(
+        target=watcher.run,
+        args=(callback,),
+        kwargs={"stop": stop, "poll_timeout": 0.05},
+    )
+    thread.start()
+    try:
+        write(source, "set_color(0, 0, 255, duration=2)\n", mtime=5000)
+        assert stop.wait(5)
+    finally:
+        stop.set()
+        thread.join()
+
+    assert [result.input for result in results] == [str(source)]
+    assert results[0].error is None
+    assert (tmp_path / "show.oled").read_text() == (
+        "set_color(0, 0, 255, duration=2)\nend()\n"
+    )
+
+
+def test_watchdog_events():
+    def event(event_type, src_path="show.led", is_directory=False, **kwds):
+        return SimpleNamespace(
+            event_type=event_type,
+            src_path=src_path,
+            is_directory=is_directory,
+            **kwds,
+        )
+
+    assert _get_changed_path(event("created")) == "show.led"
+    assert _get_changed_path(event("modified", b"show.led")) == "show.led"
+    assert _get_changed_path(event("moved", dest_path="new.led")) == "new.led"
+
+    # Reading a file (e.g., when the watcher compiles it) must not trigger
+    # another compilation
+    for event_type in ("opened", "closed", "closed_no_write", "deleted"):
+        assert _get_changed_path(event(event_type)) is None
+    assert _get_changed_path(event("created", "sub", is_directory=True)) is None
+
+
+@pytest.mark.benchmark
+def test_latency_in_large_show(tmp_path):
+    template = (
+        Path(__file__).parent / "data" / "compiler" / "show_file_1.led"
+    ).read_text()
+    for index in range(3000):
+        write(tmp_path / "drone_{0:04}.led".format(index), template)
+
+    source = tmp_path / "drone_1234.led"
+    monitor = PollingFileMonitor(tmp_path, interval=0.01)
+    watcher = Watcher(monitor)
+    watcher.compile_files([str(source)])
+
+    latencies = []
+    done = Event()
+    stop = Event()
+
+    def callback(result):
+        latencies.append(perf_counter() - edited_at)
+        done.set()
+
+    thread = Thread(
+        target=watcher.run,
+        args=(callback,),
+        kwargs={"stop": stop, "poll_timeout": 0.05},
+    )
+    thread.start()
+    try:
+        for index in range(5):
+            done.clear()
+            edited_at = perf_counter()
+            write(source, template.replace("255", str(index), 1), mtime=index)
+            assert done.wait(5)
+    finally:
+        stop.set()
+        thread.join()
+
+    print("latency of edits: " + ", ".join("{0:.3f}s".format(x) for x in latencies))
+    assert max(latencies) < 0.1